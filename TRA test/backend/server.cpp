@@ -3,13 +3,16 @@
 #include <string>
 #include <algorithm>
 #include <array>
+#include <charconv>
 #include <cmath>
+#include <cctype>
 #include <cstdint>
 #include <iomanip>
 #include <limits>
 #include <numeric>
 #include <optional>
 #include <random>
+#include <string_view>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -18,6 +21,30 @@
 #include <cstdlib>
 #include <map>
 #include <functional>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+#include <filesystem>
+#include <list>
+#include <unordered_map>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -81,6 +108,38 @@ struct PlaneData {
 	size_t numPoints;
 };
 
+// Points per row of a plane sent in tiles of rows; one whose point count is not a multiple of its width is one row
+static size_t planeTileColumns(const PlaneData& planeData) {
+	return planeData.width > 0 && planeData.numPoints % planeData.width == 0 ? planeData.width : planeData.numPoints;
+}
+
+// Compact receiver plane: height rows x width columns of points spanning a parallelogram, one shared
+// normal. Corners are given like polygons: (row 0, col 0), (row 0, last col), (last row, last col),
+// (last row, col 0).
+struct ReceiverGrid {
+	Vec3 corners[4];
+	Vec3 normal;
+};
+
+// Receiver points one request may hold in total, grids counted once expanded
+static constexpr size_t kMaxReceiverPoints = size_t {1} << 24;
+
+// Row-major like the frontend's generatePointsOnPlane: point(row, col) =
+// c0 + (c1 - c0) * col / (cols - 1) + (c3 - c0) * row / (rows - 1)
+static void expandReceiverGrid(const ReceiverGrid& grid, size_t cols, size_t rows, std::vector<ReceiverPoint>& out) {
+	const Vec3 alongCols = grid.corners[1] - grid.corners[0];
+	const Vec3 alongRows = grid.corners[3] - grid.corners[0];
+	out.reserve(out.size() + cols * rows);
+	for (size_t row = 0; row < rows; ++row) {
+		const double v = rows > 1 ? static_cast<double>(row) / static_cast<double>(rows - 1) : 0.0;
+		const Vec3 rowStart = grid.corners[0] + alongRows * v;
+		for (size_t col = 0; col < cols; ++col) {
+			const double u = cols > 1 ? static_cast<double>(col) / static_cast<double>(cols - 1) : 0.0;
+			out.push_back({rowStart + alongCols * u, grid.normal});
+		}
+	}
+}
+
 // Compute plane from polygon vertices (assumes first 3 non-collinear define plane)
 inline std::optional<Plane> getPolygonPlane(const std::vector<Vec3>& verts) {
     if (verts.size() < 3) return std::nullopt;
@@ -145,23 +204,22 @@ inline bool isPointInPolygon3D(const Vec3& p, const std::vector<Vec3>& polygon,
     return isPointInPolygon2D(poly2d, pc[a], pc[b]);
 }
 
-// Generate cosine-weighted hemisphere directions around a given normal (using provided RNG)
-std::vector<Vec3> generateCosineHemisphereRays(size_t numRays, const Vec3& surfaceNormal, std::mt19937_64& rng) {
-    std::vector<Vec3> rays;
-    if (numRays == 0) return rays;
-    rays.reserve(numRays);
+// Cosine-weighted hemisphere directions around a surface normal, drawn one at a time from the RNG
+struct CosineHemisphereSampler {
+    Vec3 u, v, w;
+    std::uniform_real_distribution<double> dist {0.0, 1.0};
 
-    Vec3 w = normalize(surfaceNormal);
-    Vec3 u;
-    if (std::fabs(w.x) > 0.9999) {
-        u = normalize(cross({0.0, 1.0, 0.0}, w));
-    } else {
-        u = normalize(cross({1.0, 0.0, 0.0}, w));
+    explicit CosineHemisphereSampler(const Vec3& surfaceNormal) {
+        w = normalize(surfaceNormal);
+        if (std::fabs(w.x) > 0.9999) {
+            u = normalize(cross({0.0, 1.0, 0.0}, w));
+        } else {
+            u = normalize(cross({1.0, 0.0, 0.0}, w));
+        }
+        v = cross(w, u);
     }
-	Vec3 v = cross(w, u);
-    std::uniform_real_distribution<double> dist(0.0, 1.0);
 
-    for (size_t i = 0; i < numRays; ++i) {
+    Vec3 next(std::mt19937_64& rng) {
         double u1 = dist(rng);
         double u2 = dist(rng);
         double phi = 2.0 * M_PI * u1;
@@ -170,75 +228,186 @@ std::vector<Vec3> generateCosineHemisphereRays(size_t numRays, const Vec3& surfa
         double x = sinTheta * std::cos(phi);
         double y = sinTheta * std::sin(phi);
         double z = cosTheta;
-        Vec3 local {x, y, z};
         // rotate to world
-        Vec3 world {
-            u.x * local.x + v.x * local.y + w.x * local.z,
-            u.y * local.x + v.y * local.y + w.y * local.z,
-            u.z * local.x + v.z * local.y + w.z * local.z
+        return {
+            u.x * x + v.x * y + w.x * z,
+            u.y * x + v.y * y + w.y * z,
+            u.z * x + v.z * y + w.z * z
         };
-        rays.push_back(world);
+    }
+};
+
+// Generate cosine-weighted hemisphere directions around a given normal (using provided RNG)
+std::vector<Vec3> generateCosineHemisphereRays(size_t numRays, const Vec3& surfaceNormal, std::mt19937_64& rng) {
+    std::vector<Vec3> rays;
+    if (numRays == 0) return rays;
+    rays.reserve(numRays);
+
+    CosineHemisphereSampler sampler(surfaceNormal);
+    for (size_t i = 0; i < numRays; ++i) {
+        rays.push_back(sampler.next(rng));
     }
     return rays;
 }
 
+// Cooperative cancellation shared between a running calculation and whoever may stop it
+// (client disconnect, the job-cancel API, server shutdown). The engine polls it every
+// kCancelCheckRays rays, so a stop request takes effect mid-plane rather than after it.
+struct CancelToken {
+	std::atomic<bool> cancelled {false};
+	std::atomic<const char*> reason {nullptr};
+	// Optional liveness probe of the result consumer (e.g. wraps sink.is_writable); false means gone
+	std::function<bool()> isConsumerAlive;
+
+	void cancel(const char* why) {
+		const char* expected = nullptr;
+		reason.compare_exchange_strong(expected, why);
+		cancelled.store(true);
+	}
+	// Returns true once the job should stop; also consults the consumer probe
+	bool poll() {
+		if (cancelled.load(std::memory_order_relaxed)) return true;
+		if (isConsumerAlive && !isConsumerAlive()) {
+			cancel("client disconnected");
+			return true;
+		}
+		return false;
+	}
+	const char* why() const {
+		const char* r = reason.load();
+		return r ? r : "cancelled";
+	}
+};
+
+static constexpr size_t kCancelCheckRays = 4096;
+
 // Calculate view factors from a point origin to a set of polygon emitters with occlusion between them
 struct ViewFactorResult {
     std::vector<double> viewFactors; // per polygon
     std::vector<Vec3> allRayDirs;
     std::vector<Vec3> hitPoints;
     std::vector<Vec3> hitRayDirs; // those rays that hit some polygon
+    bool cancelled {false}; // stopped early via CancelToken; viewFactors are then meaningless
 };
 
-ViewFactorResult calculateViewFactorsWithBlockage(
-	const Vec3& origin,
-	const Vec3& originNormal,
-	const std::vector<PolygonWithTemp>& emitterPolygons,
-	const std::vector<std::vector<Vec3>>& inertPolygons,
-	size_t numRays,
-	std::mt19937_64& rng
-) {
-	ViewFactorResult res;
-	res.viewFactors.assign(emitterPolygons.size(), 0.0);
-	if (numRays == 0) return res;
+// Polygon prepared once per job: supporting plane, dominant-axis projection and a slice of the
+// projected vertex array. Plain data only, so a compiled scene can live in shared memory.
+struct CompiledPolygon {
+	Vec3 normal;
+	Vec3 point;
+	std::uint32_t firstVertex; // index of the first (x, y) pair in the projected vertex array
+	std::uint32_t vertexCount;
+	std::uint32_t axisA;       // coordinates kept by the projection (0 = x, 1 = y, 2 = z)
+	std::uint32_t axisB;
+	std::uint32_t valid;       // 0 for degenerate polygons, which are never hit
+	std::uint32_t reserved;
+	double temperature;        // emitters only
+};
+
+// Non-owning view the kernel traces against; backed by a CompiledScene or a shared-memory segment
+struct SceneView {
+	const CompiledPolygon* emitters;
+	size_t numEmitters;
+	const CompiledPolygon* inert;
+	size_t numInert;
+	const double* vertices2d; // (x, y) pairs
+};
 
-	std::vector<Vec3> rays = generateCosineHemisphereRays(numRays, originNormal, rng);
-	res.allRayDirs = rays;
+struct CompiledScene {
+	std::vector<CompiledPolygon> emitters;
+	std::vector<CompiledPolygon> inert;
+	std::vector<double> vertices2d;
 
-	struct PolyData { std::vector<Vec3> verts; Vec3 normal; Vec3 point; bool valid; };
-	std::vector<PolyData> inertScene;
-	inertScene.reserve(inertPolygons.size());
-	for (const auto& poly : inertPolygons) {
-		auto pl = getPolygonPlane(poly);
-		if (!pl) inertScene.push_back({poly, {0,0,0}, {0,0,0}, false});
-		else inertScene.push_back({poly, pl->normal, pl->point, true});
+	SceneView view() const {
+		return {emitters.data(), emitters.size(), inert.data(), inert.size(), vertices2d.data()};
+	}
+};
+
+static CompiledPolygon compilePolygon(const std::vector<Vec3>& verts, double temperature, std::vector<double>& vertices2d) {
+	CompiledPolygon cp {};
+	cp.temperature = temperature;
+	cp.firstVertex = static_cast<std::uint32_t>(vertices2d.size() / 2);
+	cp.vertexCount = static_cast<std::uint32_t>(verts.size());
+	auto pl = getPolygonPlane(verts);
+	if (!pl) return cp;
+	cp.valid = 1;
+	cp.normal = pl->normal;
+	cp.point = pl->point;
+
+	// Same projection as isPointInPolygon3D, done once instead of per ray
+	Vec3 absn { std::fabs(cp.normal.x), std::fabs(cp.normal.y), std::fabs(cp.normal.z) };
+	if (absn.x >= absn.y && absn.x >= absn.z) { cp.axisA = 1; cp.axisB = 2; }
+	else if (absn.y >= absn.x && absn.y >= absn.z) { cp.axisA = 0; cp.axisB = 2; }
+	else { cp.axisA = 0; cp.axisB = 1; }
+	for (const auto& v : verts) {
+		double coords[3] = {v.x, v.y, v.z};
+		vertices2d.push_back(coords[cp.axisA]);
+		vertices2d.push_back(coords[cp.axisB]);
 	}
+	return cp;
+}
 
-	std::vector<PolyData> emitScene;
-	emitScene.reserve(emitterPolygons.size());
+static CompiledScene compileScene(const std::vector<PolygonWithTemp>& emitterPolygons, const std::vector<std::vector<Vec3>>& inertPolygons) {
+	CompiledScene scene;
+	scene.emitters.reserve(emitterPolygons.size());
+	scene.inert.reserve(inertPolygons.size());
 	for (const auto& poly : emitterPolygons) {
-		auto pl = getPolygonPlane(poly.vertices);
-		if (!pl) emitScene.push_back({poly.vertices, {0,0,0}, {0,0,0}, false});
-		else emitScene.push_back({poly.vertices, pl->normal, pl->point, true});
+		scene.emitters.push_back(compilePolygon(poly.vertices, poly.temperature, scene.vertices2d));
+	}
+	for (const auto& poly : inertPolygons) {
+		scene.inert.push_back(compilePolygon(poly, 0.0, scene.vertices2d));
 	}
+	return scene;
+}
 
-	std::vector<std::size_t> hitCounts(emitterPolygons.size(), 0);
+static inline bool isHitInsideCompiled(const CompiledPolygon& cp, const double* vertices2d, const Vec3& p) {
+	double pc[3] = {p.x, p.y, p.z};
+	const double x = pc[cp.axisA];
+	const double y = pc[cp.axisB];
+	const double* poly = vertices2d + 2 * static_cast<size_t>(cp.firstVertex);
+	const size_t n = cp.vertexCount;
+	// Ray casting even-odd rule (as isPointInPolygon2D)
+	bool inside = false;
+	for (size_t i = 0, j = n - 1; i < n; j = i++) {
+		const double* pi = poly + 2 * i;
+		const double* pj = poly + 2 * j;
+		bool intersect = ((pi[1] > y) != (pj[1] > y)) &&
+		                 (x < (pj[0] - pi[0]) * (y - pi[1]) / ((pj[1] - pi[1]) + 1e-30) + pi[0]);
+		if (intersect) inside = !inside;
+	}
+	return inside;
+}
+
+// Traces numRays cosine-weighted rays from origin and counts, per emitter, the rays whose nearest
+// emitter hit is not blocked by a closer inert polygon. hitCounts must hold scene.numEmitters entries.
+// detail (optional) receives every ray direction and hit. Returns false if cancel fired.
+static bool traceEmitterHits(const SceneView& scene, const Vec3& origin, const Vec3& originNormal, size_t numRays,
+                             std::mt19937_64& rng, CancelToken* cancel, std::size_t* hitCounts,
+                             ViewFactorResult* detail = nullptr) {
+	std::fill(hitCounts, hitCounts + scene.numEmitters, std::size_t {0});
+	if (numRays == 0) return true;
+	if (detail) detail->allRayDirs.reserve(numRays);
 
+	CosineHemisphereSampler sampler(originNormal);
 	for (size_t i = 0; i < numRays; ++i) {
-		const Vec3& rdir = rays[i];
+		if (cancel && i > 0 && (i % kCancelCheckRays) == 0 && cancel->poll()) {
+			return false;
+		}
+		const Vec3 rdir = sampler.next(rng);
+		if (detail) detail->allRayDirs.push_back(rdir);
 		double closestInert = std::numeric_limits<double>::infinity();
 		double closestEmit = std::numeric_limits<double>::infinity();
 		int finalIdx = -1;
 		Vec3 closestPoint;
 
 		// Check inert polygons first (find closest inert hit)
-		for (size_t p = 0; p < inertScene.size(); ++p) {
-			const auto& pd = inertScene[p];
+		for (size_t p = 0; p < scene.numInert; ++p) {
+			const CompiledPolygon& pd = scene.inert[p];
 			if (!pd.valid) continue;
 			auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
 			if (hit) {
 				if (t < closestInert) {
-					if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
+					if (isHitInsideCompiled(pd, scene.vertices2d, *hit)) {
 						closestInert = t;
 					}
 				}
@@ -246,13 +415,13 @@ ViewFactorResult calculateViewFactorsWithBlockage(
 		}
 
 		// Then check emitter polygons (find closest emitter hit)
-		for (size_t p = 0; p < emitScene.size(); ++p) {
-			const auto& pd = emitScene[p];
+		for (size_t p = 0; p < scene.numEmitters; ++p) {
+			const CompiledPolygon& pd = scene.emitters[p];
 			if (!pd.valid) continue;
 			auto [hit, t] = rayPlaneIntersect(origin, rdir, pd.normal, pd.point);
 			if (hit) {
 				if (t < closestEmit) {
-					if (isPointInPolygon3D(*hit, pd.verts, pd.normal)) {
+					if (isHitInsideCompiled(pd, scene.vertices2d, *hit)) {
 						closestEmit = t;
 						finalIdx = static_cast<int>(p);
 						closestPoint = *hit;
@@ -264,10 +433,58 @@ ViewFactorResult calculateViewFactorsWithBlockage(
 		bool blockedByInert = (closestInert < std::numeric_limits<double>::infinity()) && (closestInert <= closestEmit);
 		if (!blockedByInert && finalIdx != -1) {
 			hitCounts[static_cast<size_t>(finalIdx)] += 1;
-			res.hitPoints.push_back(closestPoint);
-			res.hitRayDirs.push_back(rdir);
+			if (detail) {
+				detail->hitPoints.push_back(closestPoint);
+				detail->hitRayDirs.push_back(rdir);
+			}
 		}
 	}
+	return true;
+}
+
+// Sum of view factor * emitter temperature for one point's per-emitter hit counts
+static double weightHitCounts(const SceneView& scene, size_t numRays, const std::size_t* hitCounts) {
+	double totalTemperature = 0.0;
+	for (size_t p = 0; p < scene.numEmitters; ++p) {
+		const double viewFactor = numRays > 0 ? static_cast<double>(hitCounts[p]) / static_cast<double>(numRays) : 0.0;
+		totalTemperature += viewFactor * scene.emitters[p].temperature;
+	}
+	return totalTemperature;
+}
+
+// Sum of viewFactor × temperature over all emitters for one receiver point. Returns false if cancelled.
+static bool tracePointTemperature(const SceneView& scene, const ReceiverPoint& rp, size_t numRays, std::mt19937_64& rng,
+                                  CancelToken* cancel, std::vector<std::size_t>& hitScratch, double& totalTemperature) {
+	hitScratch.resize(scene.numEmitters);
+	if (!traceEmitterHits(scene, rp.origin, rp.normal, numRays, rng, cancel, hitScratch.data())) return false;
+	totalTemperature = weightHitCounts(scene, numRays, hitScratch.data());
+	return true;
+}
+
+// Per-point RNG seed; shared by every execution path so results don't depend on where a point runs
+static inline std::uint64_t receiverPointSeed(std::uint64_t seed, size_t globalPointIndex) {
+	return seed + static_cast<std::uint64_t>(globalPointIndex) * 12345;
+}
+
+ViewFactorResult calculateViewFactorsWithBlockage(
+	const Vec3& origin,
+	const Vec3& originNormal,
+	const std::vector<PolygonWithTemp>& emitterPolygons,
+	const std::vector<std::vector<Vec3>>& inertPolygons,
+	size_t numRays,
+	std::mt19937_64& rng,
+	CancelToken* cancel = nullptr
+) {
+	ViewFactorResult res;
+	res.viewFactors.assign(emitterPolygons.size(), 0.0);
+	if (numRays == 0) return res;
+
+	const CompiledScene scene = compileScene(emitterPolygons, inertPolygons);
+	std::vector<std::size_t> hitCounts(emitterPolygons.size(), 0);
+	if (!traceEmitterHits(scene.view(), origin, originNormal, numRays, rng, cancel, hitCounts.data(), &res)) {
+		res.cancelled = true;
+		return res;
+	}
 
 	for (size_t p = 0; p < emitterPolygons.size(); ++p) {
 		res.viewFactors[p] = static_cast<double>(hitCounts[p]) / static_cast<double>(numRays);
@@ -275,303 +492,448 @@ ViewFactorResult calculateViewFactorsWithBlockage(
 	return res;
 }
 
-// JSON parsing functions
-namespace mini_json {
-	inline void skipSpaces(const std::string& s, size_t& i) {
-		while (i < s.size() && (s[i] == ' ' || s[i] == '\n' || s[i] == '\r' || s[i] == '\t')) ++i;
-	}
-	inline bool expectChar(const std::string& s, size_t& i, char c) {
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == c) { ++i; return true; }
-		return false;
-	}
-	inline bool parseNumber(const std::string& s, size_t& i, double& out) {
-		skipSpaces(s, i);
-		const char* start = s.c_str() + i;
-		char* endptr = nullptr;
-		out = std::strtod(start, &endptr);
-		if (endptr == start) return false;
-		i += static_cast<size_t>(endptr - start);
-		return true;
+// Progressive refinement (/calculate/stream only): a low-ray pass over every plane, then rounds that
+// double each point's rays until num_rays, the deadline or the tolerance is reached
+struct ProgressiveOptions {
+	std::size_t initialRays {1000};
+	double deadlineMs {0.0}; // 0: no deadline
+	double tolerance {0.0};  // stop once every point's standard error is at or below this; 0: off
+};
+
+// A receiver plane's sampling grid: point(row, col) = origin + alongCols * col + alongRows * row
+struct GridFrame {
+	Vec3 origin;
+	Vec3 alongCols;
+	Vec3 alongRows;
+};
+
+using GridFrames = std::map<std::string, GridFrame>;
+
+// How result numbers are written: their text in JSON, their quantization in q16 frames
+struct ValuePrecision {
+	enum class Mode { Significant, Shortest, Decimals };
+	// "precision": 6 significant digits by default, "shortest" (the shortest text that reads back as
+	// the same double), or a number of decimals
+	Mode mode {Mode::Significant};
+	// Significant digits, or decimals; unused by Shortest
+	int digits {6};
+	// "max_error": absolute error quantized binary results may make beyond 16-bit rounding
+	double maxError {0.0};
+
+	bool operator==(const ValuePrecision& o) const { return mode == o.mode && digits == o.digits && maxError == o.maxError; }
+};
+
+// What a result says about each plane, and how a stream delivers it. Like precision, none of it is
+// part of the request's identity.
+struct OutputOptions {
+	enum class Content { Values, Summary, Contours };
+	// "output": the values, per-plane reductions in their place, or nothing but contours
+	Content content {Content::Values};
+	// "thresholds": a summary reports the area at or above each
+	std::vector<double> thresholds;
+	// "contours": isoline levels, added to any content
+	std::vector<double> contourLevels;
+	// Where each plane's points lie; set just before a run when a summary or contours need them
+	std::shared_ptr<const GridFrames> frames;
+	// "tile_rows": a stream sends values in tiles of this many rows ahead of each plane event
+	size_t tileRows {0};
+	// How values, summaries and contours write their numbers
+	ValuePrecision precision;
+
+	// Plane JSON carries numbers computed from the values (a summary or contours)
+	bool derived() const { return content == Content::Summary || !contourLevels.empty(); }
+
+	// frames follow from the request, so they need no comparing
+	bool operator==(const OutputOptions& o) const {
+		return content == o.content && thresholds == o.thresholds && contourLevels == o.contourLevels && tileRows == o.tileRows &&
+		       precision == o.precision;
 	}
-	inline bool parseUInt64(const std::string& s, size_t& i, std::uint64_t& out) {
-		skipSpaces(s, i);
-		const char* start = s.c_str() + i;
-		char* endptr = nullptr;
-		unsigned long long v = std::strtoull(start, &endptr, 10);
-		if (endptr == start) return false;
-		out = static_cast<std::uint64_t>(v);
-		i += static_cast<size_t>(endptr - start);
-		return true;
+};
+
+static constexpr size_t kMaxContourLevels = 256;
+
+static constexpr int kMaxValueDecimals = 17;
+
+// Locale-independent std::to_chars formatting, appended to a reused buffer
+static void appendJsonNumber(std::string& out, double v, const ValuePrecision& precision) {
+	char buf[384]; // fixed notation of the largest double with kMaxValueDecimals decimals
+	char* const end = buf + sizeof(buf);
+	const std::to_chars_result r = precision.mode == ValuePrecision::Mode::Shortest ? std::to_chars(buf, end, v)
+	                               : precision.mode == ValuePrecision::Mode::Decimals
+	                                   ? std::to_chars(buf, end, v, std::chars_format::fixed, precision.digits)
+	                                   : std::to_chars(buf, end, v, std::chars_format::general, precision.digits);
+	out.append(buf, r.ptr);
+}
+
+static void appendJsonNumbers(std::string& out, const std::vector<double>& values, const ValuePrecision& precision) {
+	out += '[';
+	for (size_t i = 0; i < values.size(); ++i) {
+		if (i > 0) out += ',';
+		appendJsonNumber(out, values[i], precision);
 	}
-	inline bool parseKey(const std::string& s, size_t& i, const std::string& key) {
-		skipSpaces(s, i);
-		if (!expectChar(s, i, '"')) return false;
-		size_t k = i;
-		while (k < s.size() && s[k] != '"') ++k;
-		if (k >= s.size()) return false;
-		std::string found = s.substr(i, k - i);
-		i = k + 1;
-		skipSpaces(s, i);
-		if (!expectChar(s, i, ':')) return false;
-		return found == key;
-	}
-	inline bool parseVec3(const std::string& s, size_t& i, Vec3& v) {
-		if (!expectChar(s, i, '[')) return false;
-		double a, b, c;
-		if (!parseNumber(s, i, a)) return false;
-		if (!expectChar(s, i, ',')) return false;
-		if (!parseNumber(s, i, b)) return false;
-		if (!expectChar(s, i, ',')) return false;
-		if (!parseNumber(s, i, c)) return false;
-		if (!expectChar(s, i, ']')) return false;
-		v = Vec3{a, b, c};
-		return true;
+	out += ']';
+}
+
+// JSON parsing functions
+namespace mini_json {
+	// Bytes a structural scan has to look at: string quotes, brackets and commas
+	inline const std::array<bool, 256>& structuralChars() {
+		static const std::array<bool, 256> table = []() {
+			std::array<bool, 256> t {};
+			for (unsigned char c : std::string_view("\"[]{},")) t[c] = true;
+			return t;
+		}();
+		return table;
 	}
-	inline bool parsePolygons(const std::string& s, size_t& i, std::vector<std::vector<Vec3>>& polys) {
-		if (!expectChar(s, i, '[')) return false; // polygons array start
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		while (i < s.size()) {
-			if (!expectChar(s, i, '[')) return false; // one polygon start
-			std::vector<Vec3> poly;
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ']') { ++i; polys.push_back(std::move(poly)); }
-			else {
-				while (i < s.size()) {
-					Vec3 v;
-					if (!parseVec3(s, i, v)) return false;
-					poly.push_back(v);
-					skipSpaces(s, i);
-					if (i < s.size() && s[i] == ',') { ++i; continue; }
-					if (i < s.size() && s[i] == ']') { ++i; break; }
-					return false;
+
+	// Single-pass reader for scene payloads. Keys are views into the body matched in place, so members
+	// dispatch without rewinding or allocating; numbers are converted with from_chars straight into
+	// their destination. Unknown members are skipped.
+	class Reader {
+	public:
+		explicit Reader(const std::string& s, size_t pos = 0)
+			: begin_(s.data()), p_(s.data() + pos), end_(s.data() + s.size()) {}
+		// Only s[pos, end) is read
+		Reader(const std::string& s, size_t pos, size_t end)
+			: begin_(s.data()), p_(s.data() + pos), end_(s.data() + end) {}
+
+		size_t offset() const { return static_cast<size_t>(p_ - begin_); }
+		// Same body, positioned at pos
+		Reader at(size_t pos) const {
+			Reader r(*this);
+			r.p_ = begin_ + pos;
+			return r;
+		}
+
+		bool atEnd() {
+			skipSpaces();
+			return p_ >= end_;
+		}
+		bool peek(char c) {
+			skipSpaces();
+			return p_ < end_ && *p_ == c;
+		}
+		bool expect(char c) {
+			if (!peek(c)) return false;
+			++p_;
+			return true;
+		}
+		// Escapes are not interpreted
+		bool string(std::string_view& out) {
+			if (!expect('"')) return false;
+			const void* close = std::memchr(p_, '"', static_cast<size_t>(end_ - p_));
+			if (!close) return false;
+			out = std::string_view(p_, static_cast<size_t>(static_cast<const char*>(close) - p_));
+			p_ = static_cast<const char*>(close) + 1;
+			return true;
+		}
+		bool number(double& out) {
+			skipSpaces();
+			const std::from_chars_result r = std::from_chars(p_, end_, out);
+			if (r.ec != std::errc()) return false;
+			p_ = r.ptr;
+			return true;
+		}
+		bool uint64(std::uint64_t& out) {
+			skipSpaces();
+			const std::from_chars_result r = std::from_chars(p_, end_, out);
+			if (r.ec != std::errc()) return false;
+			p_ = r.ptr;
+			return true;
+		}
+		bool boolean(bool& out) {
+			skipSpaces();
+			if (literal("true")) { out = true; return true; }
+			if (literal("false")) { out = false; return true; }
+			return false;
+		}
+		bool vec3(Vec3& v) {
+			return expect('[') && number(v.x) && expect(',') && number(v.y) && expect(',') && number(v.z) && expect(']');
+		}
+
+		// onMember(key) must consume the member's value
+		template <typename Fn>
+		bool object(Fn&& onMember) {
+			if (!expect('{')) return false;
+			if (expect('}')) return true;
+			do {
+				std::string_view key;
+				if (!string(key) || !expect(':') || !onMember(key)) return false;
+			} while (expect(','));
+			return expect('}');
+		}
+		template <typename Fn>
+		bool array(Fn&& onElement) {
+			if (!expect('[')) return false;
+			if (expect(']')) return true;
+			do {
+				if (!onElement()) return false;
+			} while (expect(','));
+			return expect(']');
+		}
+
+		bool skipValue() {
+			skipSpaces();
+			if (p_ >= end_) return false;
+			if (*p_ == '"') { std::string_view ignored; return string(ignored); }
+			if (*p_ == '{') return object([this](std::string_view) { return skipValue(); });
+			if (*p_ == '[') return array([this]() { return skipValue(); });
+			const char* start = p_;
+			while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' && *p_ != ' ' && *p_ != '\n' && *p_ != '\r' && *p_ != '\t') ++p_;
+			return p_ != start;
+		}
+
+		// Structural pre-scan of an array: counts its elements and records the offset of every
+		// `every`-th one without converting anything. Elements are validated when they are parsed.
+		bool scanArray(size_t every, std::vector<size_t>& starts, size_t& count) {
+			const std::array<bool, 256>& structural = structuralChars();
+			count = 0;
+			if (!expect('[')) return false;
+			if (expect(']')) return true;
+			size_t depth = 0;
+			auto element = [&]() {
+				skipSpaces();
+				if (count++ % every == 0) starts.push_back(offset());
+			};
+			element();
+			for (; p_ < end_; ++p_) {
+				while (p_ < end_ && !structural[static_cast<unsigned char>(*p_)]) ++p_;
+				if (p_ >= end_) break;
+				switch (*p_) {
+				case '"': {
+					const void* close = std::memchr(p_ + 1, '"', static_cast<size_t>(end_ - p_ - 1));
+					if (!close) return false;
+					p_ = static_cast<const char*>(close);
+					break;
+				}
+				case '[': case '{': ++depth; break;
+				case ']': case '}':
+					if (depth > 0) { --depth; break; }
+					if (*p_ != ']') return false;
+					++p_;
+					return true;
+				default: // ','
+					if (depth == 0) {
+						++p_;
+						element();
+						--p_;
+					}
+					break;
 				}
-				polys.push_back(std::move(poly));
 			}
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
 			return false;
 		}
-		return true;
-	}
-	inline bool parseReceiverPoint(const std::string& s, size_t& i, ReceiverPoint& rp) {
-		if (!expectChar(s, i, '{')) return false;
-		
-		bool haveOrigin = false, haveNormal = false;
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			size_t save = i;
-			if (parseKey(s, i, "origin")) {
-				Vec3 v; if (!parseVec3(s, i, v)) return false;
-				rp.origin = v; haveOrigin = true;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "normal")) {
-				Vec3 v; if (!parseVec3(s, i, v)) return false;
-				rp.normal = v; haveNormal = true;
-			} else { i = save; }
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		
-		return haveOrigin && haveNormal;
-	}
-	inline bool parseReceiverPoints(const std::string& s, size_t& i, std::vector<ReceiverPoint>& points) {
-		if (!expectChar(s, i, '[')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		
-		while (i < s.size()) {
-			ReceiverPoint rp;
-			if (!parseReceiverPoint(s, i, rp)) return false;
-			points.push_back(rp);
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
+
+		void skipSpaces() {
+			while (p_ < end_ && isSpace(*p_)) ++p_;
 		}
-		return true;
+
+	private:
+		static bool isSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+		bool literal(std::string_view word) {
+			if (static_cast<size_t>(end_ - p_) < word.size() || std::memcmp(p_, word.data(), word.size()) != 0) return false;
+			p_ += word.size();
+			return true;
+		}
+
+		const char* begin_;
+		const char* p_;
+		const char* end_;
+	};
+
+	// [[x,y,z], ...] appended to vertices
+	inline bool readPolygon(Reader& r, std::vector<Vec3>& vertices) {
+		return r.array([&]() {
+			vertices.emplace_back();
+			return r.vec3(vertices.back());
+		});
 	}
-	
-	inline bool parseReceiverPlaneData(const std::string& s, size_t& i, std::string& planeName, double& width, double& height, std::vector<ReceiverPoint>& points) {
-		if (!expectChar(s, i, '{')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == '}') { ++i; return true; }
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			size_t save = i;
-			if (parseKey(s, i, "width")) {
-				double w;
-				if (!parseNumber(s, i, w)) return false;
-				width = w;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "height")) {
-				double h;
-				if (!parseNumber(s, i, h)) return false;
-				height = h;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "points")) {
-				if (!parseReceiverPoints(s, i, points)) return false;
-			} else { i = save; }
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
+
+	// {"polygon": [...], "temperature": T}, or a bare vertex array (legacy, temperature 0)
+	inline bool readPolygons(Reader& r, std::vector<PolygonWithTemp>& polys) {
+		return r.array([&]() {
+			PolygonWithTemp& poly = polys.emplace_back();
+			poly.temperature = 0.0;
+			if (r.peek('[')) return readPolygon(r, poly.vertices);
+			bool havePolygon = false, haveTemperature = false;
+			return r.object([&](std::string_view key) {
+				if (key == "polygon") return havePolygon = readPolygon(r, poly.vertices);
+				if (key == "temperature") return haveTemperature = r.number(poly.temperature);
+				return r.skipValue();
+			}) && havePolygon && haveTemperature;
+		});
+	}
+
+	inline bool readPolygonList(Reader& r, std::vector<std::vector<Vec3>>& polys) {
+		return r.array([&]() { return readPolygon(r, polys.emplace_back()); });
+	}
+
+	// true/false, or {"initial_rays": N, "deadline_ms": D, "tolerance": T} with every field optional
+	inline bool readProgressiveOptions(Reader& r, std::optional<ProgressiveOptions>& out) {
+		bool flag = false;
+		if (r.boolean(flag)) {
+			if (flag) out = ProgressiveOptions(); else out.reset();
+			return true;
 		}
+		ProgressiveOptions opts;
+		const bool ok = r.object([&](std::string_view key) {
+			double v = 0.0;
+			if (!r.number(v) || v < 0) return false;
+			if (key == "initial_rays") opts.initialRays = static_cast<std::size_t>(v);
+			else if (key == "deadline_ms") opts.deadlineMs = v;
+			else if (key == "tolerance") opts.tolerance = v;
+			else return false;
+			return true;
+		});
+		if (!ok) return false;
+		if (opts.initialRays == 0) opts.initialRays = 1;
+		out = opts;
 		return true;
 	}
-	
-	inline bool parseReceiverPlanes(const std::string& s, size_t& i, std::string& planeName, double& width, double& height, std::vector<ReceiverPoint>& points) {
-		if (!expectChar(s, i, '{')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == '}') { ++i; return true; }
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			// Parse plane name as key
-			if (!expectChar(s, i, '"')) return false;
-			size_t nameStart = i;
-			while (i < s.size() && s[i] != '"') ++i;
-			if (i >= s.size()) return false;
-			planeName = s.substr(nameStart, i - nameStart);
-			++i; // skip closing quote
-			
-			skipSpaces(s, i);
-			if (!expectChar(s, i, ':')) return false;
-			
-			if (!parseReceiverPlaneData(s, i, planeName, width, height, points)) return false;
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
+
+	// "shortest" or a number of decimals
+	inline bool readValuePrecision(Reader& r, ValuePrecision& out) {
+		std::string_view mode;
+		if (r.string(mode)) {
+			if (mode != "shortest") return false;
+			out.mode = ValuePrecision::Mode::Shortest;
+			return true;
 		}
+		std::uint64_t decimals = 0;
+		if (!r.uint64(decimals) || decimals > static_cast<std::uint64_t>(kMaxValueDecimals)) return false;
+		out.mode = ValuePrecision::Mode::Decimals;
+		out.digits = static_cast<int>(decimals);
 		return true;
 	}
-	
-	// New function to parse multiple receiver planes into a map
-	inline bool parseReceiverPlanesMulti(const std::string& s, size_t& i, std::map<std::string, PlaneData>& planeMap, std::vector<ReceiverPoint>& allPoints) {
-		if (!expectChar(s, i, '{')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == '}') { ++i; return true; }
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			// Parse plane name as key
-			if (!expectChar(s, i, '"')) return false;
-			size_t nameStart = i;
-			while (i < s.size() && s[i] != '"') ++i;
-			if (i >= s.size()) return false;
-			std::string planeName = s.substr(nameStart, i - nameStart);
-			++i; // skip closing quote
-			
-			skipSpaces(s, i);
-			if (!expectChar(s, i, ':')) return false;
-			
-			// Parse plane data
-			double width = 0, height = 0;
-			std::vector<ReceiverPoint> planePoints;
-			std::string tempName;
-			if (!parseReceiverPlaneData(s, i, tempName, width, height, planePoints)) return false;
-			
-			// Store plane metadata
-			PlaneData pd;
-			pd.width = static_cast<size_t>(width);
-			pd.height = static_cast<size_t>(height);
-			pd.numPoints = planePoints.size();
-			planeMap[planeName] = pd;
-			
-			// Add points to global list
-			for (const auto& pt : planePoints) {
-				allPoints.push_back(pt);
-			}
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
+
+	// {"corners": [[x,y,z] x4], "normal": [x,y,z]}
+	inline bool readReceiverGrid(Reader& r, ReceiverGrid& grid) {
+		bool haveCorners = false, haveNormal = false;
+		return r.object([&](std::string_view key) {
+			if (key == "corners") {
+				haveCorners = r.expect('[') && r.vec3(grid.corners[0]) && r.expect(',') && r.vec3(grid.corners[1]) &&
+				              r.expect(',') && r.vec3(grid.corners[2]) && r.expect(',') && r.vec3(grid.corners[3]) && r.expect(']');
+				return haveCorners;
+			}
+			if (key == "normal") return haveNormal = r.vec3(grid.normal);
+			return r.skipValue();
+		}) && haveCorners && haveNormal;
+	}
+
+	inline bool readReceiverPoint(Reader& r, ReceiverPoint& rp) {
+		bool haveOrigin = false, haveNormal = false;
+		return r.object([&](std::string_view field) {
+			if (field == "origin") return haveOrigin = r.vec3(rp.origin);
+			if (field == "normal") return haveNormal = r.vec3(rp.normal);
+			return r.skipValue();
+		}) && haveOrigin && haveNormal;
+	}
+
+	// Up to kPointChunk consecutive elements of a pre-scanned points array, parsed into
+	// points[slot, slot + count). What follows the last one must end at `end`: the ',' and the next
+	// chunk's first element, or the array's closing ']'.
+	static constexpr size_t kPointChunk = 4096;
+	struct PointChunk {
+		Reader from;
+		size_t slot;
+		size_t count;
+		size_t end;
+		bool closesArray;
+	};
+
+	inline bool readPointChunk(const PointChunk& chunk, std::vector<ReceiverPoint>& points) {
+		Reader r = chunk.from;
+		for (size_t k = 0; k < chunk.count; ++k) {
+			if (k > 0 && !r.expect(',')) return false;
+			if (!readReceiverPoint(r, points[chunk.slot + k])) return false;
 		}
-		return true;
+		if (chunk.closesArray) {
+			r.skipSpaces();
+			return r.offset() == chunk.end && r.expect(']');
+		}
+		if (!r.expect(',')) return false;
+		r.skipSpaces();
+		return r.offset() == chunk.end;
 	}
-	
-	inline bool parseSinglePolygon(const std::string& s, size_t& i, std::vector<Vec3>& vertices) {
-		if (!expectChar(s, i, '[')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		
-		while (i < s.size()) {
-			Vec3 v;
-			if (!parseVec3(s, i, v)) return false;
-			vertices.push_back(v);
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
+
+	// {"width": W, "height": H, "points": [{"origin": [...], "normal": [...]}, ...]} or a "grid" spec in
+	// place of points. Points are appended to points in request order; pd.numPoints counts them. With
+	// deferred, points arrays are only pre-scanned: their slots are reserved and the chunks to parse
+	// into them are added to deferred. otherPoints counts the request's points held outside points;
+	// together they stay within kMaxReceiverPoints.
+	inline bool readReceiverPlane(Reader& r, PlaneData& pd, std::vector<ReceiverPoint>& points,
+	                              std::vector<PointChunk>* deferred = nullptr, size_t otherPoints = 0) {
+		const size_t first = points.size();
+		const size_t limit = kMaxReceiverPoints - std::min(otherPoints, kMaxReceiverPoints);
+		double width = 0, height = 0;
+		ReceiverGrid grid;
+		bool haveGrid = false;
+		const bool ok = r.object([&](std::string_view key) {
+			if (key == "width") return r.number(width);
+			if (key == "height") return r.number(height);
+			if (key == "grid") return haveGrid = readReceiverGrid(r, grid);
+			if (key == "points" && deferred) {
+				std::vector<size_t> starts;
+				size_t count = 0;
+				if (!r.scanArray(kPointChunk, starts, count)) return false;
+				// Reject before reserving slots so an oversized array never allocates
+				if (points.size() > limit || count > limit - points.size()) return false;
+				const size_t base = points.size();
+				points.resize(base + count);
+				for (size_t c = 0; c < starts.size(); ++c) {
+					const bool last = c + 1 == starts.size();
+					const size_t end = last ? r.offset() - 1 : starts[c + 1];
+					deferred->push_back({r.at(starts[c]), base + c * kPointChunk, std::min(kPointChunk, count - c * kPointChunk), end, last});
+				}
+				return true;
+			}
+			if (key == "points") {
+				return r.array([&]() { return readReceiverPoint(r, points.emplace_back()); });
+			}
+			return r.skipValue();
+		});
+		if (!ok) return false;
+		// Whole, in range numbers only: from_chars also accepts inf, nan and fractions
+		auto isCount = [](double v) { return v >= 0.0 && v <= static_cast<double>(kMaxReceiverPoints) && v == std::floor(v); };
+		if (!isCount(width) || !isCount(height)) return false;
+		const size_t cols = static_cast<size_t>(width), rows = static_cast<size_t>(height);
+		if (haveGrid) {
+			if (points.size() != first || cols < 1 || rows < 1) return false;
+			if (points.size() > limit || cols > (limit - points.size()) / rows) return false;
+			expandReceiverGrid(grid, cols, rows, points);
 		}
+		if (points.size() > limit) return false;
+		pd.width = cols;
+		pd.height = rows;
+		pd.numPoints = points.size() - first;
 		return true;
 	}
-	
-	inline bool parsePolygonWithTemp(const std::string& s, size_t& i, PolygonWithTemp& poly) {
-		if (!expectChar(s, i, '{')) return false;
-		
-		bool havePolygon = false, haveTemperature = false;
-		
-		while (i < s.size()) {
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == '}') { ++i; break; }
-			
-			size_t save = i;
-			if (parseKey(s, i, "polygon")) {
-				if (!parseSinglePolygon(s, i, poly.vertices)) return false;
-				havePolygon = true;
-			} else { i = save; }
-			
-			save = i;
-			if (parseKey(s, i, "temperature")) {
-				double temp;
-				if (!parseNumber(s, i, temp)) return false;
-				poly.temperature = temp;
-				haveTemperature = true;
-			} else { i = save; }
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-		}
-		
-		return havePolygon && haveTemperature;
+
+	// Parses deferred chunks on up to `threads` threads; each writes only its own slots
+	inline bool readPointChunks(const std::vector<PointChunk>& chunks, std::vector<ReceiverPoint>& points, size_t threads) {
+		std::atomic<size_t> next {0};
+		std::atomic<bool> ok {true};
+		auto work = [&]() {
+			for (size_t c = next++; c < chunks.size() && ok.load(std::memory_order_relaxed); c = next++) {
+				if (!readPointChunk(chunks[c], points)) ok = false;
+			}
+		};
+		std::vector<std::thread> pool;
+		for (size_t t = 1; t < std::min(threads, chunks.size()); ++t) pool.emplace_back(work);
+		work();
+		for (auto& t : pool) t.join();
+		return ok.load();
 	}
-	
-	inline bool parsePolygonsWithTemp(const std::string& s, size_t& i, std::vector<PolygonWithTemp>& polys) {
-		if (!expectChar(s, i, '[')) return false;
-		skipSpaces(s, i);
-		if (i < s.size() && s[i] == ']') { ++i; return true; }
-		
-		while (i < s.size()) {
-			PolygonWithTemp poly;
-			if (!parsePolygonWithTemp(s, i, poly)) return false;
-			polys.push_back(poly);
-			
-			skipSpaces(s, i);
-			if (i < s.size() && s[i] == ',') { ++i; continue; }
-			if (i < s.size() && s[i] == ']') { ++i; break; }
-			return false;
-		}
-		return true;
+
+	// {"<plane name>": {...}, ...}; every plane's points go straight into allPoints
+	inline bool readReceiverPlanes(Reader& r, std::map<std::string, PlaneData>& planeMap, std::vector<ReceiverPoint>& allPoints,
+	                               std::vector<PointChunk>* deferred = nullptr) {
+		return r.object([&](std::string_view name) {
+			PlaneData pd {};
+			if (!readReceiverPlane(r, pd, allPoints, deferred)) return false;
+			planeMap[std::string(name)] = pd;
+			return true;
+		});
 	}
 }
 
@@ -581,82 +943,92 @@ struct JsonInput {
 	std::vector<std::vector<Vec3>> inertPolygons;
 	std::size_t numRays {100000};
 	std::optional<std::uint64_t> seed;
+	// Global index of receiverPoints[0] in the original request; shards keep per-point seeds stable
+	std::size_t pointIndexOffset {0};
+	// Client accepts a stored result for an unseeded request (seeded ones are always reusable)
+	bool reuseResults {false};
+	// viewFactorKey of a prior run; points an edit cannot affect reuse its hit counts
+	std::string baseKey;
+	// Prebuilt from polygons/inertPolygons (kept by sessions); otherwise compiled per run
+	std::shared_ptr<const CompiledScene> compiledScene;
+	std::optional<ProgressiveOptions> progressive;
+	// What results carry and how their numbers are written; not part of the request's identity
+	OutputOptions output;
 	
 	// Map of plane name -> plane metadata
 	std::map<std::string, PlaneData> planeDataMap;
 };
 
-static bool parseInputJson(const std::string& json, JsonInput& out, std::string& error) {
+// One top-level member of a calculation request other than receiver_planes; unknown ones are skipped
+static bool readInputMember(mini_json::Reader& r, std::string_view key, JsonInput& out, bool& havePolygons, std::string& error) {
 	using namespace mini_json;
-	size_t i = 0;
-	skipSpaces(json, i);
-	if (!expectChar(json, i, '{')) { error = "Expected '{'"; return false; }
-
-	bool haveReceiverPlanes = false, havePolygons = false;
-
-	while (i < json.size()) {
-		skipSpaces(json, i);
-		if (i < json.size() && json[i] == '}') { ++i; break; }
-
-		size_t save = i;
-		if (parseKey(json, i, "receiver_planes")) {
-			if (!parseReceiverPlanesMulti(json, i, out.planeDataMap, out.receiverPoints)) { 
-				error = "Invalid receiver_planes"; 
-				return false; 
-			}
-			haveReceiverPlanes = true;
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "polygons")) {
-			size_t savePos = i;
-			if (parsePolygonsWithTemp(json, i, out.polygons)) {
-				havePolygons = true;
-			} else {
-				i = savePos;
-				std::vector<std::vector<Vec3>> legacyPolygons;
-				if (parsePolygons(json, i, legacyPolygons)) {
-					out.polygons.clear();
-					for (const auto& poly : legacyPolygons) {
-						out.polygons.push_back({poly, 0.0});
-					}
-					havePolygons = true;
-				} else {
-					error = "Invalid polygons format";
-					return false;
-				}
-			}
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "inert_polygons")) {
-			std::vector<std::vector<Vec3>> tmp;
-			if (!parsePolygons(json, i, tmp)) { error = "Invalid inert_polygons"; return false; }
-			out.inertPolygons = std::move(tmp);
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "num_rays")) {
-			double n; if (!parseNumber(json, i, n)) { error = "Invalid num_rays"; return false; }
-			if (n < 0) n = 0; out.numRays = static_cast<std::size_t>(n);
-		} else { i = save; }
-
-		save = i;
-		if (parseKey(json, i, "seed")) {
-			std::uint64_t s; if (!parseUInt64(json, i, s)) { error = "Invalid seed"; return false; }
-			out.seed = s;
-		} else { i = save; }
-
-		skipSpaces(json, i);
-		if (i < json.size() && json[i] == ',') { ++i; continue; }
+	if (key == "polygons") {
+		if (!readPolygons(r, out.polygons)) { error = "Invalid polygons format"; return false; }
+		havePolygons = true;
+	} else if (key == "inert_polygons") {
+		out.inertPolygons.clear();
+		if (!readPolygonList(r, out.inertPolygons)) { error = "Invalid inert_polygons"; return false; }
+	} else if (key == "num_rays") {
+		double n;
+		if (!r.number(n)) { error = "Invalid num_rays"; return false; }
+		out.numRays = static_cast<std::size_t>(std::max(n, 0.0));
+	} else if (key == "seed") {
+		std::uint64_t s;
+		if (!r.uint64(s)) { error = "Invalid seed"; return false; }
+		out.seed = s;
+	} else if (key == "reuse_results") {
+		if (!r.boolean(out.reuseResults)) { error = "Invalid reuse_results"; return false; }
+	} else if (key == "progressive") {
+		if (!readProgressiveOptions(r, out.progressive)) { error = "Invalid progressive"; return false; }
+	} else if (key == "precision") {
+		if (!readValuePrecision(r, out.output.precision)) { error = "Invalid precision"; return false; }
+	} else if (key == "max_error") {
+		double& maxError = out.output.precision.maxError;
+		if (!r.number(maxError) || !(maxError >= 0.0)) { error = "Invalid max_error"; return false; }
+	} else if (key == "output") {
+		std::string_view content;
+		if (!r.string(content)) { error = "Invalid output"; return false; }
+		if (content == "values") out.output.content = OutputOptions::Content::Values;
+		else if (content == "summary") out.output.content = OutputOptions::Content::Summary;
+		else if (content == "contours") out.output.content = OutputOptions::Content::Contours;
+		else { error = "Invalid output"; return false; }
+	} else if (key == "thresholds") {
+		auto& thresholds = out.output.thresholds;
+		thresholds.clear();
+		if (!r.array([&]() { return r.number(thresholds.emplace_back()); })) { error = "Invalid thresholds"; return false; }
+	} else if (key == "tile_rows") {
+		std::uint64_t rows;
+		if (!r.uint64(rows)) { error = "Invalid tile_rows"; return false; }
+		out.output.tileRows = static_cast<size_t>(rows);
+	} else if (key == "contours") {
+		auto& levels = out.output.contourLevels;
+		levels.clear();
+		if (!r.array([&]() { return r.number(levels.emplace_back()); }) || levels.size() > kMaxContourLevels) {
+			error = "Invalid contours";
+			return false;
+		}
+	} else if (key == "base") {
+		std::string_view base;
+		if (!r.string(base)) { error = "Invalid base"; return false; }
+		out.baseKey.assign(base);
+	} else if (key == "point_offset") {
+		std::uint64_t off;
+		if (!r.uint64(off)) { error = "Invalid point_offset"; return false; }
+		out.pointIndexOffset = static_cast<std::size_t>(off);
+	} else if (!r.skipValue()) {
+		error = "Invalid value for " + std::string(key);
+		return false;
 	}
+	return true;
+}
 
+static bool checkParsedInput(const JsonInput& in, bool haveReceiverPlanes, bool havePolygons, std::string& error) {
 	if (!haveReceiverPlanes) {
 		error = "Must provide 'receiver_planes' field";
 		return false;
 	}
 	
-	if (out.receiverPoints.empty()) {
+	if (in.receiverPoints.empty()) {
 		error = "receiver_planes is empty";
 		return false;
 	}
@@ -665,174 +1037,5419 @@ static bool parseInputJson(const std::string& json, JsonInput& out, std::string&
 	return true;
 }
 
-// Invoked once per receiver plane after its grid has been computed. Return false to stop processing.
-using ReceiverPlaneDoneFn = std::function<bool(
-    const std::string& planeName,
-    const PlaneData& planeData,
-    const std::vector<double>& planeTemperatures,
-    size_t planeIndex1Based,
-    size_t totalPlanes)>;
+// threads > 1: points arrays are only pre-scanned during the main pass, then their chunks are
+// parsed concurrently into the reserved slots
+static bool parseInputJson(const std::string& json, JsonInput& out, std::string& error, size_t threads = 1) {
+	using namespace mini_json;
+	Reader r(json);
+	std::vector<PointChunk> chunks;
+	bool haveReceiverPlanes = false, havePolygons = false;
+	const bool ok = r.object([&](std::string_view key) {
+		if (key != "receiver_planes") return readInputMember(r, key, out, havePolygons, error);
+		if (!readReceiverPlanes(r, out.planeDataMap, out.receiverPoints, threads > 1 ? &chunks : nullptr)) {
+			error = "Invalid receiver_planes";
+			return false;
+		}
+		haveReceiverPlanes = true;
+		return true;
+	});
+	if (!ok) {
+		if (error.empty()) error = "Malformed JSON near offset " + std::to_string(r.offset());
+		return false;
+	}
+	if (!chunks.empty() && !readPointChunks(chunks, out.receiverPoints, threads)) {
+		error = "Invalid receiver_planes";
+		return false;
+	}
+	return checkParsedInput(out, haveReceiverPlanes, havePolygons, error);
+}
 
-static bool processReceiverPlanes(JsonInput& in, std::mt19937_64& rng, const ReceiverPlaneDoneFn& onPlaneDone) {
-	size_t globalPointIdx = 0;
-	const size_t totalPlanes = in.planeDataMap.size();
-	size_t planeIndex = 0;
+// ===== Binary request format =====
+//
+// Content-Type application/vnd.tra.scene: the same request as the JSON body, as a fixed header
+// followed by 8-byte aligned sections, all little-endian, in this order:
+//   vertices       double[3 * numVertices]        emitter polygons' vertices, then inert polygons'
+//   polygonStarts  uint64[numEmitters + numInert + 1]  first vertex of each polygon, then numVertices
+//   temperatures   double[numEmitters]
+//   planes         BinaryPlane[numPlanes]         in the order their points appear
+//   points         double[6 * numPoints]          origin xyz, normal xyz: ReceiverPoint's layout
+//   names          char[namesBytes]               plane names, referenced by BinaryPlane
+//   base           char[baseKeyBytes]
+//   thresholds     double[numThresholds]          OutputOptions: the header carries the rest
+//   contours       double[numContourLevels]
+// Arrays are copied out whole, never parsed number by number. Coordinates stay doubles, the numbers
+// JSON carries, so both formats describe exactly the same scene.
 
-	std::cout << "=== Processing " << totalPlanes << " receiver planes ===" << std::endl;
-	std::cout << "Total receiver points: " << in.receiverPoints.size() << std::endl;
+static constexpr const char* kBinaryRequestContentType = "application/vnd.tra.scene";
+static constexpr std::uint32_t kBinaryRequestMagic = 0x31515254; // "TRQ1"
+static constexpr std::uint32_t kBinaryRequestVersion = 2;
 
-	for (const auto& planePair : in.planeDataMap) {
-		const std::string& planeName = planePair.first;
-		const PlaneData& planeData = planePair.second;
-		++planeIndex;
+static constexpr std::uint64_t kBinaryHasSeed = 1;
+static constexpr std::uint64_t kBinaryReuseResults = 2;
+static constexpr std::uint64_t kBinaryProgressive = 4;
 
-		std::cout << "Processing plane: \"" << planeName << "\"" << std::endl;
-		std::cout << "  Grid: " << planeData.width << "x" << planeData.height << std::endl;
-		std::cout << "  Num points: " << planeData.numPoints << std::endl;
-		std::cout << "  Starting at globalPointIdx: " << globalPointIdx << std::endl;
+struct BinaryRequestHeader {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::uint64_t flags;
+	std::uint64_t numRays;
+	std::uint64_t seed;
+	std::uint64_t pointIndexOffset;
+	std::uint64_t progressiveInitialRays;
+	double progressiveDeadlineMs;
+	double progressiveTolerance;
+	std::uint64_t numEmitters;
+	std::uint64_t numInert;
+	std::uint64_t numVertices;
+	std::uint64_t numPlanes;
+	std::uint64_t numPoints;
+	std::uint64_t namesBytes;
+	std::uint64_t baseKeyBytes;
+	std::uint64_t outputContent;     // OutputOptions::Content: 0 values, 1 summary, 2 contours
+	std::uint64_t precisionMode;     // ValuePrecision::Mode: 0 six significant digits, 1 shortest, 2 decimals
+	std::uint64_t precisionDecimals; // with precisionMode 2
+	double maxError;
+	std::uint64_t tileRows;
+	std::uint64_t numThresholds;
+	std::uint64_t numContourLevels;
+};
 
-		if (globalPointIdx < in.receiverPoints.size()) {
-			const auto& firstPoint = in.receiverPoints[globalPointIdx];
-			std::cout << "  Sample point 0 origin: [" << firstPoint.origin.x << ", " << firstPoint.origin.y << ", " << firstPoint.origin.z << "]" << std::endl;
-			std::cout << "  Sample point 0 normal: [" << firstPoint.normal.x << ", " << firstPoint.normal.y << ", " << firstPoint.normal.z << "]" << std::endl;
-		}
+struct BinaryPlane {
+	std::uint64_t nameOffset;
+	std::uint64_t nameBytes;
+	std::uint64_t width;
+	std::uint64_t height;
+	std::uint64_t numPoints; // explicit points taken in order from the points section; 0 with a grid
+	std::uint64_t hasGrid;
+	double corners[12];      // ReceiverGrid corners, used with hasGrid
+	double normal[3];
+};
 
-		std::cout << "  Number of emitters: " << in.polygons.size() << std::endl;
-		for (size_t i = 0; i < in.polygons.size(); ++i) {
-			std::cout << "    Emitter " << i << ": temp=" << in.polygons[i].temperature << ", vertices=" << in.polygons[i].vertices.size() << std::endl;
-			if (in.polygons[i].vertices.size() > 0) {
-				std::cout << "      First vertex: [" << in.polygons[i].vertices[0].x << ", " << in.polygons[i].vertices[0].y << ", " << in.polygons[i].vertices[0].z << "]" << std::endl;
-			}
-		}
+static_assert(sizeof(Vec3) == 3 * sizeof(double), "Vec3 must be three packed doubles");
+static_assert(sizeof(ReceiverPoint) == 6 * sizeof(double), "ReceiverPoint must be six packed doubles");
 
-		std::vector<double> planeTemperatures;
-		planeTemperatures.reserve(planeData.numPoints);
+static bool isBinaryRequest(const std::string& contentType) {
+	return contentType.compare(0, std::strlen(kBinaryRequestContentType), kBinaryRequestContentType) == 0;
+}
+
+static bool hostIsLittleEndian() {
+	const std::uint16_t probe = 1;
+	unsigned char first;
+	std::memcpy(&first, &probe, 1);
+	return first == 1;
+}
+
+// Section offsets of a request with these counts; false if they cannot fit in `size` bytes
+struct BinaryRequestLayout {
+	std::uint64_t vertices, polygonStarts, temperatures, planes, points, names, base, thresholds, contours, end;
+
+	bool compute(const BinaryRequestHeader& h, std::uint64_t size) {
+		// Every count is bounded by the body before any multiplication, so nothing overflows
+		const std::uint64_t polygons = h.numEmitters + h.numInert;
+		if (h.numEmitters > size || h.numInert > size || h.numVertices > size || h.numPlanes > size || h.numPoints > size ||
+		    h.namesBytes > size || h.baseKeyBytes > size || h.numThresholds > size || h.numContourLevels > size) {
+			return false;
+		}
+		std::uint64_t at = align8(sizeof(BinaryRequestHeader));
+		auto section = [&at](std::uint64_t bytes) {
+			const std::uint64_t start = at;
+			at = align8(at + bytes);
+			return start;
+		};
+		vertices = section(h.numVertices * sizeof(Vec3));
+		polygonStarts = section((polygons + 1) * sizeof(std::uint64_t));
+		temperatures = section(h.numEmitters * sizeof(double));
+		planes = section(h.numPlanes * sizeof(BinaryPlane));
+		points = section(h.numPoints * sizeof(ReceiverPoint));
+		names = section(h.namesBytes);
+		base = section(h.baseKeyBytes);
+		thresholds = section(h.numThresholds * sizeof(double));
+		contours = section(h.numContourLevels * sizeof(double));
+		end = at;
+		return end <= size;
+	}
+
+	static std::uint64_t align8(std::uint64_t n) { return (n + 7) & ~static_cast<std::uint64_t>(7); }
+};
+
+static bool parseBinaryInput(const std::string& body, JsonInput& out, std::string& error) {
+	if (!hostIsLittleEndian()) { error = "Binary requests are not supported on this server"; return false; }
+	BinaryRequestHeader h;
+	if (body.size() < sizeof(h)) { error = "Binary request too short"; return false; }
+	std::memcpy(&h, body.data(), sizeof(h));
+	if (h.magic != kBinaryRequestMagic || h.version != kBinaryRequestVersion) { error = "Unknown binary request version"; return false; }
+	BinaryRequestLayout at;
+	if (!at.compute(h, body.size()) || at.end != body.size()) { error = "Binary request size does not match its header"; return false; }
+	const char* base = body.data();
+
+	std::vector<std::uint64_t> starts(static_cast<size_t>(h.numEmitters + h.numInert + 1));
+	std::memcpy(starts.data(), base + at.polygonStarts, starts.size() * sizeof(std::uint64_t));
+	if (starts.front() != 0 || starts.back() != h.numVertices || !std::is_sorted(starts.begin(), starts.end())) {
+		error = "Invalid polygon offsets";
+		return false;
+	}
+	auto copyVertices = [&](size_t polygon, std::vector<Vec3>& vertices) {
+		vertices.resize(static_cast<size_t>(starts[polygon + 1] - starts[polygon]));
+		std::memcpy(static_cast<void*>(vertices.data()), base + at.vertices + starts[polygon] * sizeof(Vec3), vertices.size() * sizeof(Vec3));
+	};
+	out.polygons.resize(static_cast<size_t>(h.numEmitters));
+	for (size_t k = 0; k < out.polygons.size(); ++k) {
+		copyVertices(k, out.polygons[k].vertices);
+		std::memcpy(&out.polygons[k].temperature, base + at.temperatures + k * sizeof(double), sizeof(double));
+	}
+	out.inertPolygons.resize(static_cast<size_t>(h.numInert));
+	for (size_t k = 0; k < out.inertPolygons.size(); ++k) copyVertices(out.polygons.size() + k, out.inertPolygons[k]);
+
+	if (h.numPoints > kMaxReceiverPoints) { error = "Too many receiver points"; return false; }
+	out.receiverPoints.reserve(static_cast<size_t>(h.numPoints));
+	std::uint64_t pointsUsed = 0;
+	for (std::uint64_t p = 0; p < h.numPlanes; ++p) {
+		BinaryPlane plane;
+		std::memcpy(&plane, base + at.planes + p * sizeof(BinaryPlane), sizeof(plane));
+		if (plane.nameOffset > h.namesBytes || plane.nameBytes > h.namesBytes - plane.nameOffset) { error = "Invalid plane name"; return false; }
+		PlaneData pd {static_cast<size_t>(plane.width), static_cast<size_t>(plane.height), 0};
+		const size_t first = out.receiverPoints.size();
+		if (plane.hasGrid) {
+			// Explicit points still to come count against the cap too
+			const std::uint64_t room = kMaxReceiverPoints - std::min<std::uint64_t>(first + (h.numPoints - pointsUsed), kMaxReceiverPoints);
+			if (plane.numPoints != 0 || plane.width < 1 || plane.height < 1 || plane.width > room / plane.height) {
+				error = "Invalid receiver grid";
+				return false;
+			}
+			ReceiverGrid grid;
+			std::memcpy(static_cast<void*>(grid.corners), plane.corners, sizeof(grid.corners));
+			std::memcpy(static_cast<void*>(&grid.normal), plane.normal, sizeof(grid.normal));
+			expandReceiverGrid(grid, pd.width, pd.height, out.receiverPoints);
+		} else {
+			if (plane.numPoints > h.numPoints - pointsUsed) { error = "Invalid receiver plane point count"; return false; }
+			out.receiverPoints.resize(first + static_cast<size_t>(plane.numPoints));
+			std::memcpy(static_cast<void*>(out.receiverPoints.data() + first), base + at.points + pointsUsed * sizeof(ReceiverPoint),
+			            static_cast<size_t>(plane.numPoints) * sizeof(ReceiverPoint));
+			pointsUsed += plane.numPoints;
+		}
+		pd.numPoints = out.receiverPoints.size() - first;
+		out.planeDataMap[std::string(base + at.names + plane.nameOffset, static_cast<size_t>(plane.nameBytes))] = pd;
+	}
+	if (pointsUsed != h.numPoints) { error = "Unused receiver points"; return false; }
+
+	out.numRays = static_cast<std::size_t>(h.numRays);
+	if (h.flags & kBinaryHasSeed) out.seed = h.seed;
+	out.reuseResults = (h.flags & kBinaryReuseResults) != 0;
+	out.pointIndexOffset = static_cast<std::size_t>(h.pointIndexOffset);
+	if (h.flags & kBinaryProgressive) {
+		if (!(h.progressiveDeadlineMs >= 0.0) || !(h.progressiveTolerance >= 0.0)) { error = "Invalid progressive"; return false; }
+		ProgressiveOptions opts;
+		opts.initialRays = std::max<std::size_t>(1, static_cast<std::size_t>(h.progressiveInitialRays));
+		opts.deadlineMs = h.progressiveDeadlineMs;
+		opts.tolerance = h.progressiveTolerance;
+		out.progressive = opts;
+	}
+	out.baseKey.assign(base + at.base, static_cast<size_t>(h.baseKeyBytes));
+
+	OutputOptions& output = out.output;
+	if (h.outputContent > static_cast<std::uint64_t>(OutputOptions::Content::Contours)) { error = "Invalid output"; return false; }
+	output.content = static_cast<OutputOptions::Content>(h.outputContent);
+	if (h.precisionMode > static_cast<std::uint64_t>(ValuePrecision::Mode::Decimals) ||
+	    (h.precisionMode == static_cast<std::uint64_t>(ValuePrecision::Mode::Decimals) &&
+	     h.precisionDecimals > static_cast<std::uint64_t>(kMaxValueDecimals))) {
+		error = "Invalid precision";
+		return false;
+	}
+	output.precision.mode = static_cast<ValuePrecision::Mode>(h.precisionMode);
+	if (output.precision.mode == ValuePrecision::Mode::Decimals) output.precision.digits = static_cast<int>(h.precisionDecimals);
+	if (!(h.maxError >= 0.0)) { error = "Invalid max_error"; return false; }
+	output.precision.maxError = h.maxError;
+	output.tileRows = static_cast<size_t>(h.tileRows);
+	output.thresholds.resize(static_cast<size_t>(h.numThresholds));
+	std::memcpy(output.thresholds.data(), base + at.thresholds, output.thresholds.size() * sizeof(double));
+	if (h.numContourLevels > kMaxContourLevels) { error = "Invalid contours"; return false; }
+	output.contourLevels.resize(static_cast<size_t>(h.numContourLevels));
+	std::memcpy(output.contourLevels.data(), base + at.contours, output.contourLevels.size() * sizeof(double));
+	return checkParsedInput(out, true, true, error);
+}
+
+// The binary form of a parsed request: planes in calculation order, grids sent as their points
+static std::string encodeBinaryInput(const JsonInput& in) {
+	BinaryRequestHeader h {};
+	h.magic = kBinaryRequestMagic;
+	h.version = kBinaryRequestVersion;
+	h.flags = (in.seed.has_value() ? kBinaryHasSeed : 0) | (in.reuseResults ? kBinaryReuseResults : 0) |
+	          (in.progressive ? kBinaryProgressive : 0);
+	h.numRays = in.numRays;
+	h.seed = in.seed.value_or(0);
+	h.pointIndexOffset = in.pointIndexOffset;
+	if (in.progressive) {
+		h.progressiveInitialRays = in.progressive->initialRays;
+		h.progressiveDeadlineMs = in.progressive->deadlineMs;
+		h.progressiveTolerance = in.progressive->tolerance;
+	}
+	h.numEmitters = in.polygons.size();
+	h.numInert = in.inertPolygons.size();
+	for (const auto& poly : in.polygons) h.numVertices += poly.vertices.size();
+	for (const auto& poly : in.inertPolygons) h.numVertices += poly.size();
+	h.numPlanes = in.planeDataMap.size();
+	h.numPoints = in.receiverPoints.size();
+	for (const auto& kv : in.planeDataMap) h.namesBytes += kv.first.size();
+	h.baseKeyBytes = in.baseKey.size();
+	h.outputContent = static_cast<std::uint64_t>(in.output.content);
+	h.precisionMode = static_cast<std::uint64_t>(in.output.precision.mode);
+	if (in.output.precision.mode == ValuePrecision::Mode::Decimals) h.precisionDecimals = static_cast<std::uint64_t>(in.output.precision.digits);
+	h.maxError = in.output.precision.maxError;
+	h.tileRows = in.output.tileRows;
+	h.numThresholds = in.output.thresholds.size();
+	h.numContourLevels = in.output.contourLevels.size();
+
+	BinaryRequestLayout at;
+	at.compute(h, std::numeric_limits<std::uint64_t>::max());
+	std::string out(static_cast<size_t>(at.end), '\0');
+	char* base = &out[0];
+	std::memcpy(base, &h, sizeof(h));
+	std::uint64_t vertex = 0, polygon = 0;
+	auto putPolygon = [&](const std::vector<Vec3>& vertices) {
+		std::memcpy(base + at.polygonStarts + polygon++ * sizeof(std::uint64_t), &vertex, sizeof(vertex));
+		std::memcpy(base + at.vertices + vertex * sizeof(Vec3), vertices.data(), vertices.size() * sizeof(Vec3));
+		vertex += vertices.size();
+	};
+	for (size_t k = 0; k < in.polygons.size(); ++k) {
+		putPolygon(in.polygons[k].vertices);
+		std::memcpy(base + at.temperatures + k * sizeof(double), &in.polygons[k].temperature, sizeof(double));
+	}
+	for (const auto& poly : in.inertPolygons) putPolygon(poly);
+	std::memcpy(base + at.polygonStarts + polygon * sizeof(std::uint64_t), &vertex, sizeof(vertex));
+
+	std::uint64_t nameOffset = 0, plane = 0;
+	for (const auto& kv : in.planeDataMap) {
+		BinaryPlane bp {};
+		bp.nameOffset = nameOffset;
+		bp.nameBytes = kv.first.size();
+		bp.width = kv.second.width;
+		bp.height = kv.second.height;
+		bp.numPoints = kv.second.numPoints;
+		std::memcpy(base + at.planes + plane++ * sizeof(BinaryPlane), &bp, sizeof(bp));
+		std::memcpy(base + at.names + nameOffset, kv.first.data(), kv.first.size());
+		nameOffset += kv.first.size();
+	}
+	std::memcpy(base + at.points, in.receiverPoints.data(), in.receiverPoints.size() * sizeof(ReceiverPoint));
+	std::memcpy(base + at.base, in.baseKey.data(), in.baseKey.size());
+	std::memcpy(base + at.thresholds, in.output.thresholds.data(), in.output.thresholds.size() * sizeof(double));
+	std::memcpy(base + at.contours, in.output.contourLevels.data(), in.output.contourLevels.size() * sizeof(double));
+	return out;
+}
+
+// JSON or binary, by Content-Type
+static bool parseRequestBody(const std::string& body, const std::string& contentType, JsonInput& out, std::string& error,
+                             size_t threads = 1) {
+	return isBinaryRequest(contentType) ? parseBinaryInput(body, out, error) : parseInputJson(body, out, error, threads);
+}
+
+// ===== Content-addressed result cache =====
+
+// Minimal SHA-256 (FIPS 180-4) for content-addressing requests
+class Sha256 {
+public:
+	Sha256() { reset(); }
+
+	void update(const void* data, size_t len) {
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		totalBytes_ += len;
+		while (len > 0) {
+			const size_t take = std::min(len, sizeof(block_) - blockLen_);
+			std::memcpy(block_ + blockLen_, p, take);
+			blockLen_ += take;
+			p += take;
+			len -= take;
+			if (blockLen_ == sizeof(block_)) {
+				compress(block_);
+				blockLen_ = 0;
+			}
+		}
+	}
+
+	std::string hexDigest() {
+		const std::uint64_t bitLen = totalBytes_ * 8;
+		const unsigned char pad = 0x80;
+		update(&pad, 1);
+		const unsigned char zero = 0;
+		while (blockLen_ != 56) update(&zero, 1);
+		unsigned char len[8];
+		for (int k = 0; k < 8; ++k) len[k] = static_cast<unsigned char>(bitLen >> (56 - 8 * k));
+		update(len, 8);
+		static const char* hex = "0123456789abcdef";
+		std::string out;
+		out.reserve(64);
+		for (std::uint32_t word : h_) {
+			for (int shift = 28; shift >= 0; shift -= 4) out += hex[(word >> shift) & 0xf];
+		}
+		reset();
+		return out;
+	}
+
+private:
+	static std::uint32_t rotr(std::uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+	void reset() {
+		static const std::uint32_t init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		                                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+		std::copy(init, init + 8, h_);
+		blockLen_ = 0;
+		totalBytes_ = 0;
+	}
+
+	void compress(const unsigned char* block) {
+		static const std::uint32_t k[64] = {
+			0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+			0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+			0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+			0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+			0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+			0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+			0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+			0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+		std::uint32_t w[64];
+		for (int t = 0; t < 16; ++t) {
+			w[t] = (std::uint32_t(block[4 * t]) << 24) | (std::uint32_t(block[4 * t + 1]) << 16) |
+			       (std::uint32_t(block[4 * t + 2]) << 8) | std::uint32_t(block[4 * t + 3]);
+		}
+		for (int t = 16; t < 64; ++t) {
+			const std::uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+			const std::uint32_t s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+			w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+		}
+		std::uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4], f = h_[5], g = h_[6], h = h_[7];
+		for (int t = 0; t < 64; ++t) {
+			const std::uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[t] + w[t];
+			const std::uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+		}
+		h_[0] += a; h_[1] += b; h_[2] += c; h_[3] += d; h_[4] += e; h_[5] += f; h_[6] += g; h_[7] += h;
+	}
+
+	std::uint32_t h_[8];
+	unsigned char block_[64];
+	size_t blockLen_;
+	std::uint64_t totalBytes_;
+};
+
+// Feeds fixed-width little-endian fields into SHA-256 so equal scenes hash equal regardless of
+// how the JSON was written (whitespace, key order, number spelling)
+class CanonicalHasher {
+public:
+	void u64(std::uint64_t v) {
+		unsigned char b[8];
+		for (int k = 0; k < 8; ++k) b[k] = static_cast<unsigned char>(v >> (8 * k));
+		sha_.update(b, 8);
+	}
+	void f64(double v) {
+		if (v == 0.0) v = 0.0; // -0.0 and 0.0 trace identically
+		std::uint64_t bits;
+		std::memcpy(&bits, &v, sizeof(bits));
+		u64(bits);
+	}
+	void vec3(const Vec3& v) { f64(v.x); f64(v.y); f64(v.z); }
+	void str(const std::string& s) {
+		u64(s.size());
+		sha_.update(s.data(), s.size());
+	}
+	std::string hex() { return sha_.hexDigest(); }
+
+private:
+	Sha256 sha_;
+};
+
+// Canonical key of everything that determines a calculation's values. Without temperatures it
+// identifies the traced geometry, whose view factors any set of temperatures can re-weight.
+// temperatures, if given, replaces the emitters' own (one per polygon).
+static std::string hashCalculationInput(const JsonInput& in, bool includeTemperatures, const double* temperatures = nullptr) {
+	CanonicalHasher h;
+	h.str(includeTemperatures ? "tra-request-v1" : "tra-geometry-v1");
+	h.u64(in.planeDataMap.size());
+	for (const auto& kv : in.planeDataMap) {
+		h.str(kv.first);
+		h.u64(kv.second.width);
+		h.u64(kv.second.height);
+		h.u64(kv.second.numPoints);
+	}
+	h.u64(in.receiverPoints.size());
+	for (const auto& rp : in.receiverPoints) {
+		h.vec3(rp.origin);
+		h.vec3(rp.normal);
+	}
+	h.u64(in.polygons.size());
+	for (size_t p = 0; p < in.polygons.size(); ++p) {
+		const auto& poly = in.polygons[p];
+		h.u64(poly.vertices.size());
+		for (const auto& v : poly.vertices) h.vec3(v);
+		if (includeTemperatures) h.f64(temperatures ? temperatures[p] : poly.temperature);
+	}
+	h.u64(in.inertPolygons.size());
+	for (const auto& poly : in.inertPolygons) {
+		h.u64(poly.size());
+		for (const auto& v : poly) h.vec3(v);
+	}
+	h.u64(in.numRays);
+	h.u64(in.seed.has_value() ? 1 : 0);
+	h.u64(in.seed.value_or(0));
+	h.u64(in.pointIndexOffset);
+	return h.hex();
+}
+
+static std::string computeRequestKey(const JsonInput& in) { return hashCalculationInput(in, true); }
+static std::string computeGeometryKey(const JsonInput& in) { return hashCalculationInput(in, false); }
+
+// Seeded results are reproducible; unseeded ones only when the client says a stored one will do
+static bool isReusableRequest(const JsonInput& in) {
+	return in.seed.has_value() || in.reuseResults;
+}
+
+struct PlaneResult {
+	std::string name;
+	PlaneData planeData;
+	std::vector<double> values;
+};
+
+using PlaneResults = std::vector<PlaneResult>;
+
+static constexpr std::uint32_t kResultFileMagic = 0x31435254; // "TRC1"
+
+// Deletes the oldest files with this extension once the directory is over its budget
+static void trimDirectory(const std::string& dir, const char* extension, std::uintmax_t budgetBytes) {
+	namespace fs = std::filesystem;
+	std::error_code ec;
+	std::vector<std::pair<fs::file_time_type, fs::path>> files;
+	std::uintmax_t total = 0;
+	for (const auto& entry : fs::directory_iterator(dir, ec)) {
+		if (!entry.is_regular_file(ec) || entry.path().extension() != extension) continue;
+		total += entry.file_size(ec);
+		files.emplace_back(entry.last_write_time(ec), entry.path());
+	}
+	if (total <= budgetBytes) return;
+	std::sort(files.begin(), files.end());
+	for (const auto& f : files) {
+		if (total <= budgetBytes) break;
+		const std::uintmax_t size = fs::file_size(f.second, ec);
+		if (fs::remove(f.second, ec)) total -= size;
+	}
+}
+
+// Thread-safe LRU of immutable shared values under a byte budget
+template <typename Value>
+class BudgetedLru {
+public:
+	void setBudget(size_t budgetBytes) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		budget_ = budgetBytes;
+		evictLocked();
+	}
+
+	// Promotes the entry on a hit
+	std::shared_ptr<const Value> find(const std::string& key) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = index_.find(key);
+		if (it == index_.end()) return nullptr;
+		lru_.splice(lru_.begin(), lru_, it->second);
+		return it->second->value;
+	}
+
+	void insert(const std::string& key, std::shared_ptr<const Value> value, size_t bytes) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto existing = index_.find(key);
+		if (existing != index_.end()) {
+			bytes_ -= existing->second->bytes;
+			lru_.erase(existing->second);
+			index_.erase(existing);
+		}
+		if (bytes > budget_) return; // would evict everything else for one entry
+		lru_.push_front({key, std::move(value), bytes});
+		index_[key] = lru_.begin();
+		bytes_ += bytes;
+		++inserts_;
+		evictLocked();
+	}
+
+	// Appends "entries", "bytes", "budgetBytes", "inserts" and "evictions" fields to a JSON object
+	void appendStatsJson(std::ostringstream& out) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		out << "\"entries\":" << lru_.size();
+		out << ",\"bytes\":" << bytes_;
+		out << ",\"budgetBytes\":" << budget_;
+		out << ",\"inserts\":" << inserts_;
+		out << ",\"evictions\":" << evictions_;
+	}
+
+private:
+	struct Entry {
+		std::string key;
+		std::shared_ptr<const Value> value;
+		size_t bytes;
+	};
+
+	void evictLocked() {
+		while (bytes_ > budget_ && !lru_.empty()) {
+			bytes_ -= lru_.back().bytes;
+			index_.erase(lru_.back().key);
+			lru_.pop_back();
+			++evictions_;
+		}
+	}
+
+	std::mutex mutex_;
+	std::list<Entry> lru_;
+	std::unordered_map<std::string, typename std::list<Entry>::iterator> index_;
+	size_t bytes_ {0};
+	size_t budget_ {0};
+	std::uint64_t inserts_ {0};
+	std::uint64_t evictions_ {0};
+};
+
+// LRU of finished results under a memory budget, with an optional on-disk tier behind it
+class ResultCache {
+public:
+	void configure(size_t memoryBudgetBytes, const std::string& diskDir, size_t diskBudgetBytes) {
+		memory_.setBudget(memoryBudgetBytes);
+		diskDir_ = diskDir;
+		diskBudget_ = diskBudgetBytes;
+		if (!diskDir_.empty()) {
+			std::error_code ec;
+			std::filesystem::create_directories(diskDir_, ec);
+		}
+	}
+
+	// tier is set to "memory", "disk" or "miss"
+	std::shared_ptr<const PlaneResults> lookup(const std::string& key, const char*& tier) {
+		if (auto planes = memory_.find(key)) {
+			++memoryHits_;
+			tier = "memory";
+			return planes;
+		}
+		if (!diskDir_.empty()) {
+			auto planes = std::make_shared<PlaneResults>();
+			if (readFile(pathFor(key), *planes)) {
+				++diskHits_;
+				tier = "disk";
+				memory_.insert(key, planes, footprint(*planes));
+				return planes;
+			}
+		}
+		++misses_;
+		tier = "miss";
+		return nullptr;
+	}
+
+	std::shared_ptr<const PlaneResults> insert(const std::string& key, PlaneResults planes) {
+		auto shared = std::make_shared<const PlaneResults>(std::move(planes));
+		memory_.insert(key, shared, footprint(*shared));
+		if (!diskDir_.empty()) {
+			std::lock_guard<std::mutex> lock(diskMutex_);
+			writeFile(key, *shared);
+		}
+		return shared;
+	}
+
+	std::string metricsJson() {
+		const std::uint64_t memoryHits = memoryHits_.load();
+		const std::uint64_t diskHits = diskHits_.load();
+		const std::uint64_t misses = misses_.load();
+		const std::uint64_t lookups = memoryHits + diskHits + misses;
+		std::ostringstream out;
+		out << "{";
+		memory_.appendStatsJson(out);
+		out << ",\"memoryHits\":" << memoryHits;
+		out << ",\"diskHits\":" << diskHits;
+		out << ",\"misses\":" << misses;
+		out << ",\"hitRate\":" << (lookups ? static_cast<double>(memoryHits + diskHits) / lookups : 0.0);
+		out << ",\"diskTier\":" << (diskDir_.empty() ? "false" : "true") << "}";
+		return out.str();
+	}
+
+private:
+	static size_t footprint(const PlaneResults& planes) {
+		size_t bytes = sizeof(PlaneResults);
+		for (const auto& p : planes) bytes += sizeof(PlaneResult) + p.name.size() + p.values.size() * sizeof(double);
+		return bytes;
+	}
+
+	std::string pathFor(const std::string& key) const { return diskDir_ + "/" + key + ".trc"; }
+
+	static bool readFile(const std::string& path, PlaneResults& planes) {
+		std::ifstream f(path, std::ios::binary);
+		if (!f) return false;
+		auto readU64 = [&f](std::uint64_t& v) { return static_cast<bool>(f.read(reinterpret_cast<char*>(&v), sizeof(v))); };
+		std::uint32_t magic = 0;
+		std::uint64_t count = 0;
+		if (!f.read(reinterpret_cast<char*>(&magic), sizeof(magic)) || magic != kResultFileMagic || !readU64(count)) return false;
+		planes.clear();
+		for (std::uint64_t k = 0; k < count; ++k) {
+			PlaneResult p;
+			std::uint64_t nameLen, width, height, n;
+			if (!readU64(nameLen) || nameLen > (1u << 20)) return false;
+			p.name.resize(nameLen);
+			if (!f.read(&p.name[0], static_cast<std::streamsize>(nameLen))) return false;
+			if (!readU64(width) || !readU64(height) || !readU64(n) || n > (1ull << 32)) return false;
+			p.planeData = {static_cast<size_t>(width), static_cast<size_t>(height), static_cast<size_t>(n)};
+			p.values.resize(n);
+			if (!f.read(reinterpret_cast<char*>(p.values.data()), static_cast<std::streamsize>(n * sizeof(double)))) return false;
+			planes.push_back(std::move(p));
+		}
+		return true;
+	}
+
+	// Written to a temp file and renamed, so readers never see a partial result
+	void writeFile(const std::string& key, const PlaneResults& planes) {
+		const std::string path = pathFor(key);
+		const std::string tmp = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		{
+			std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+			if (!f) return;
+			auto writeU64 = [&f](std::uint64_t v) { f.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+			f.write(reinterpret_cast<const char*>(&kResultFileMagic), sizeof(kResultFileMagic));
+			writeU64(planes.size());
+			for (const auto& p : planes) {
+				writeU64(p.name.size());
+				f.write(p.name.data(), static_cast<std::streamsize>(p.name.size()));
+				writeU64(p.planeData.width);
+				writeU64(p.planeData.height);
+				writeU64(p.values.size());
+				f.write(reinterpret_cast<const char*>(p.values.data()), static_cast<std::streamsize>(p.values.size() * sizeof(double)));
+			}
+			if (!f) {
+				f.close();
+				std::remove(tmp.c_str());
+				return;
+			}
+		}
+		std::error_code ec;
+		std::filesystem::rename(tmp, path, ec);
+		if (ec) std::filesystem::remove(tmp, ec);
+		trimDirectory(diskDir_, ".trc", diskBudget_);
+	}
+
+	BudgetedLru<PlaneResults> memory_;
+	std::mutex diskMutex_;
+	std::string diskDir_;
+	size_t diskBudget_ {1024u << 20};
+	std::atomic<std::uint64_t> memoryHits_ {0};
+	std::atomic<std::uint64_t> diskHits_ {0};
+	std::atomic<std::uint64_t> misses_ {0};
+};
+
+static ResultCache g_resultCache;
+
+// Read-only view of a whole file: mmap'd where available (pages load on first touch), read into
+// memory otherwise
+class MappedFile {
+public:
+	static std::shared_ptr<const MappedFile> open(const std::string& path) {
+		auto file = std::shared_ptr<MappedFile>(new MappedFile());
+#ifndef _WIN32
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return nullptr;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			::close(fd);
+			return nullptr;
+		}
+		void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) return nullptr;
+		file->mapping_ = p;
+		file->data_ = static_cast<const unsigned char*>(p);
+		file->size_ = static_cast<size_t>(st.st_size);
+#else
+		std::ifstream f(path, std::ios::binary);
+		if (!f) return nullptr;
+		file->buffer_.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+		if (file->buffer_.empty()) return nullptr;
+		file->data_ = reinterpret_cast<const unsigned char*>(file->buffer_.data());
+		file->size_ = file->buffer_.size();
+#endif
+		return file;
+	}
+	~MappedFile() {
+#ifndef _WIN32
+		if (mapping_) munmap(mapping_, size_);
+#endif
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const unsigned char* data() const { return data_; }
+	size_t size() const { return size_; }
+
+private:
+	MappedFile() = default;
+#ifndef _WIN32
+	void* mapping_ {nullptr};
+#else
+	std::vector<char> buffer_;
+#endif
+	const unsigned char* data_ {nullptr};
+	size_t size_ {0};
+};
+
+// ===== Per-emitter view factors, kept for re-weighting =====
+
+// Hit counts per receiver point and emitter in CSR form: row r (global point index) covers entries
+// [rowStart[r], rowStart[r + 1]); emitters a point never hit are not stored.
+struct ViewFactorMatrix {
+	std::size_t numRays {0};
+	std::size_t numEmitters {0};
+	std::vector<std::uint64_t> rowStart {0};
+	std::vector<std::uint32_t> emitter;
+	std::vector<std::uint32_t> hits;
+	// A matrix loaded from the run store reads the same three arrays in place from its file instead
+	std::shared_ptr<const MappedFile> mapped;
+	const std::uint64_t* mappedRowStart {nullptr};
+	const std::uint32_t* mappedEmitter {nullptr};
+	const std::uint32_t* mappedHits {nullptr};
+	std::size_t mappedRows {0};
+
+	size_t rows() const { return mapped ? mappedRows : rowStart.size() - 1; }
+	const std::uint64_t* rowStartData() const { return mapped ? mappedRowStart : rowStart.data(); }
+	const std::uint32_t* emitterData() const { return mapped ? mappedEmitter : emitter.data(); }
+	const std::uint32_t* hitsData() const { return mapped ? mappedHits : hits.data(); }
+	size_t entries() const { return rowStartData()[rows()]; }
+
+	// Heap bytes only; mapped pages belong to the page cache
+	size_t bytes() const {
+		return rowStart.size() * sizeof(std::uint64_t) + emitter.size() * sizeof(std::uint32_t) + hits.size() * sizeof(std::uint32_t);
+	}
+
+	void appendRow(const std::size_t* hitCounts) {
+		for (size_t p = 0; p < numEmitters; ++p) {
+			if (hitCounts[p] == 0) continue;
+			emitter.push_back(static_cast<std::uint32_t>(p));
+			hits.push_back(static_cast<std::uint32_t>(hitCounts[p]));
+		}
+		rowStart.push_back(emitter.size());
+	}
+
+	// Same terms in the same order as tracePointTemperature; skipped emitters only ever added 0.0,
+	// so the sums are bit-identical to a full trace with these temperatures.
+	void expandRow(size_t row, std::size_t* hitCounts) const {
+		const std::uint64_t* starts = rowStartData();
+		const std::uint32_t* columns = emitterData();
+		const std::uint32_t* counts = hitsData();
+		std::fill(hitCounts, hitCounts + numEmitters, std::size_t {0});
+		for (std::uint64_t k = starts[row]; k < starts[row + 1]; ++k) hitCounts[columns[k]] = counts[k];
+	}
+
+	double weightRow(size_t row, const double* temperatures) const {
+		const std::uint64_t* starts = rowStartData();
+		const std::uint32_t* columns = emitterData();
+		const std::uint32_t* counts = hitsData();
+		double totalTemperature = 0.0;
+		for (std::uint64_t k = starts[row]; k < starts[row + 1]; ++k) {
+			const double viewFactor = static_cast<double>(counts[k]) / static_cast<double>(numRays);
+			totalTemperature += viewFactor * temperatures[columns[k]];
+		}
+		return totalTemperature;
+	}
+};
+
+// A finished trace: the input it ran on (geometry, layout, temperatures as traced), its view factors
+// and the generator unseeded points were traced with
+struct TracedRun {
+	JsonInput input;
+	ViewFactorMatrix viewFactors;
+	std::mt19937_64 rng;
+
+	size_t bytes() const {
+		size_t total = sizeof(TracedRun) + viewFactors.bytes() + input.receiverPoints.size() * sizeof(ReceiverPoint);
+		for (const auto& poly : input.polygons) total += sizeof(PolygonWithTemp) + poly.vertices.size() * sizeof(Vec3);
+		for (const auto& poly : input.inertPolygons) total += sizeof(poly) + poly.size() * sizeof(Vec3);
+		for (const auto& kv : input.planeDataMap) total += sizeof(kv) + kv.first.size();
+		return total;
+	}
+};
+
+static BudgetedLru<TracedRun> g_tracedRuns;
+
+// ===== Run store: traced runs on disk, so view factors survive a restart =====
+//
+// One file per geometry key (<key>.tvf): a fixed header, then 8-byte aligned sections. The CSR
+// arrays are laid out exactly as ViewFactorMatrix reads them, so a loaded run maps its file and
+// uses them in place; only the scene and receiver points are copied out. A file is opened the
+// first time its key is asked for, not at startup.
+
+static constexpr std::uint32_t kRunFileMagic = 0x31465654; // "TVF1"
+static constexpr std::uint32_t kRunFileVersion = 1;        // bump whenever the layout changes
+
+struct RunFileHeader {
+	std::uint32_t magic;
+	std::uint32_t version;
+	std::uint64_t fileSize;
+	std::uint64_t numRays;
+	std::uint64_t hasSeed;
+	std::uint64_t seed;
+	std::uint64_t pointIndexOffset;
+	std::uint64_t reuseResults;
+	std::uint64_t numEmitters;
+	std::uint64_t numPoints;
+	std::uint64_t numEntries;     // stored (non-zero) view factor entries
+	std::uint64_t sceneOffset;    // planes, emitters and inert polygons as a u64 stream
+	std::uint64_t sceneBytes;
+	std::uint64_t pointsOffset;   // ReceiverPoint[numPoints]
+	std::uint64_t rowStartOffset; // uint64[numPoints + 1]
+	std::uint64_t emitterOffset;  // uint32[numEntries]
+	std::uint64_t hitsOffset;     // uint32[numEntries]
+	std::uint64_t rngOffset;      // generator state as text
+	std::uint64_t rngBytes;
+};
+
+class RunStore {
+public:
+	void configure(const std::string& dir, size_t budgetBytes) {
+		dir_ = dir;
+		budget_ = budgetBytes;
+		if (!dir_.empty()) {
+			std::error_code ec;
+			std::filesystem::create_directories(dir_, ec);
+		}
+	}
+	bool enabled() const { return !dir_.empty(); }
+
+	// Written to a temp file and renamed, so a reader never maps a partial run
+	void save(const std::string& key, const TracedRun& run) {
+		if (!enabled() || !validKey(key)) return;
+		const JsonInput& in = run.input;
+		const ViewFactorMatrix& vf = run.viewFactors;
+		std::ostringstream rngText;
+		rngText << run.rng;
+		const std::string rngState = rngText.str();
+		const std::vector<std::uint64_t> scene = encodeScene(in);
+
+		RunFileHeader h {};
+		h.magic = kRunFileMagic;
+		h.version = kRunFileVersion;
+		h.numRays = vf.numRays;
+		h.hasSeed = in.seed.has_value() ? 1 : 0;
+		h.seed = in.seed.value_or(0);
+		h.pointIndexOffset = in.pointIndexOffset;
+		h.reuseResults = in.reuseResults ? 1 : 0;
+		h.numEmitters = vf.numEmitters;
+		h.numPoints = vf.rows();
+		h.numEntries = vf.entries();
+		std::uint64_t offset = 0;
+		auto section = [&offset](std::uint64_t bytes) {
+			const std::uint64_t at = offset;
+			offset = align8(offset + bytes);
+			return at;
+		};
+		section(sizeof(RunFileHeader));
+		h.sceneBytes = scene.size() * sizeof(std::uint64_t);
+		h.sceneOffset = section(h.sceneBytes);
+		h.pointsOffset = section(h.numPoints * sizeof(ReceiverPoint));
+		h.rowStartOffset = section((h.numPoints + 1) * sizeof(std::uint64_t));
+		h.emitterOffset = section(h.numEntries * sizeof(std::uint32_t));
+		h.hitsOffset = section(h.numEntries * sizeof(std::uint32_t));
+		h.rngBytes = rngState.size();
+		h.rngOffset = section(h.rngBytes);
+		h.fileSize = offset;
+
+		const std::string path = pathFor(key);
+		const std::string tmp = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		{
+			std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+			if (!f) return;
+			auto put = [&f](std::uint64_t at, const void* data, std::uint64_t bytes) {
+				f.seekp(static_cast<std::streamoff>(at));
+				f.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+			};
+			put(0, &h, sizeof(h));
+			put(h.sceneOffset, scene.data(), h.sceneBytes);
+			put(h.pointsOffset, in.receiverPoints.data(), h.numPoints * sizeof(ReceiverPoint));
+			put(h.rowStartOffset, vf.rowStartData(), (h.numPoints + 1) * sizeof(std::uint64_t));
+			put(h.emitterOffset, vf.emitterData(), h.numEntries * sizeof(std::uint32_t));
+			put(h.hitsOffset, vf.hitsData(), h.numEntries * sizeof(std::uint32_t));
+			put(h.rngOffset, rngState.data(), h.rngBytes);
+			// Pad to the full size so every section lies inside the file
+			const char zeros[8] = {};
+			put(h.rngOffset + h.rngBytes, zeros, h.fileSize - h.rngOffset - h.rngBytes);
+			if (!f) {
+				f.close();
+				std::remove(tmp.c_str());
+				return;
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::error_code ec;
+		std::filesystem::rename(tmp, path, ec);
+		if (ec) {
+			std::filesystem::remove(tmp, ec);
+			return;
+		}
+		++writes_;
+		trimDirectory(dir_, ".tvf", budget_);
+	}
+
+	// Maps the run stored under key; null if there is none or the file does not check out
+	std::shared_ptr<TracedRun> load(const std::string& key) {
+		if (!enabled() || !validKey(key)) return nullptr;
+		auto file = MappedFile::open(pathFor(key));
+		if (!file) return nullptr;
+		auto run = std::make_shared<TracedRun>();
+		if (!decode(file, *run) || computeGeometryKey(run->input) != key) {
+			++rejected_;
+			return nullptr;
+		}
+		++loads_;
+		return run;
+	}
+
+	void appendStatsJson(std::ostringstream& out) {
+		out << ",\"store\":" << (enabled() ? "true" : "false");
+		out << ",\"storeLoads\":" << loads_.load();
+		out << ",\"storeWrites\":" << writes_.load();
+		out << ",\"storeRejected\":" << rejected_.load();
+	}
+
+private:
+	static std::uint64_t align8(std::uint64_t n) { return (n + 7) & ~static_cast<std::uint64_t>(7); }
+
+	// Keys arrive in requests, so only well-formed ones ever become paths
+	static bool validKey(const std::string& key) {
+		if (key.size() != 64) return false;
+		return std::all_of(key.begin(), key.end(), [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+	}
+
+	std::string pathFor(const std::string& key) const { return dir_ + "/" + key + ".tvf"; }
+
+	static std::uint64_t doubleBits(double d) {
+		std::uint64_t bits;
+		std::memcpy(&bits, &d, sizeof(bits));
+		return bits;
+	}
+	static double bitsDouble(std::uint64_t bits) {
+		double d;
+		std::memcpy(&d, &bits, sizeof(d));
+		return d;
+	}
+
+	static std::vector<std::uint64_t> encodeScene(const JsonInput& in) {
+		std::vector<std::uint64_t> out;
+		auto vec = [&out](const Vec3& v) {
+			out.push_back(doubleBits(v.x));
+			out.push_back(doubleBits(v.y));
+			out.push_back(doubleBits(v.z));
+		};
+		out.push_back(in.planeDataMap.size());
+		for (const auto& kv : in.planeDataMap) {
+			out.push_back(kv.first.size());
+			const size_t at = out.size();
+			out.resize(at + (kv.first.size() + 7) / 8, 0);
+			std::memcpy(out.data() + at, kv.first.data(), kv.first.size());
+			out.push_back(kv.second.width);
+			out.push_back(kv.second.height);
+			out.push_back(kv.second.numPoints);
+		}
+		out.push_back(in.polygons.size());
+		for (const auto& poly : in.polygons) {
+			out.push_back(poly.vertices.size());
+			out.push_back(doubleBits(poly.temperature));
+			for (const auto& v : poly.vertices) vec(v);
+		}
+		out.push_back(in.inertPolygons.size());
+		for (const auto& poly : in.inertPolygons) {
+			out.push_back(poly.size());
+			for (const auto& v : poly) vec(v);
+		}
+		return out;
+	}
+
+	static bool decodeScene(const std::uint64_t* words, size_t count, JsonInput& in) {
+		size_t i = 0;
+		auto next = [&](std::uint64_t& v) {
+			if (i >= count) return false;
+			v = words[i++];
+			return true;
+		};
+		auto vec = [&](Vec3& v) {
+			if (count - i < 3) return false;
+			v = {bitsDouble(words[i]), bitsDouble(words[i + 1]), bitsDouble(words[i + 2])};
+			i += 3;
+			return true;
+		};
+		std::uint64_t planes = 0, emitters = 0, inert = 0;
+		if (!next(planes)) return false;
+		for (std::uint64_t k = 0; k < planes; ++k) {
+			std::uint64_t nameLen = 0, width = 0, height = 0, points = 0;
+			if (!next(nameLen) || nameLen > (1u << 20) || (nameLen + 7) / 8 > count - i) return false;
+			const std::string name(reinterpret_cast<const char*>(words + i), static_cast<size_t>(nameLen));
+			i += static_cast<size_t>((nameLen + 7) / 8);
+			if (!next(width) || !next(height) || !next(points)) return false;
+			in.planeDataMap[name] = {static_cast<size_t>(width), static_cast<size_t>(height), static_cast<size_t>(points)};
+		}
+		if (!next(emitters)) return false;
+		for (std::uint64_t k = 0; k < emitters; ++k) {
+			std::uint64_t n = 0, temperature = 0;
+			if (!next(n) || !next(temperature) || n > count) return false;
+			PolygonWithTemp poly {std::vector<Vec3>(static_cast<size_t>(n)), bitsDouble(temperature)};
+			for (auto& v : poly.vertices) {
+				if (!vec(v)) return false;
+			}
+			in.polygons.push_back(std::move(poly));
+		}
+		if (!next(inert)) return false;
+		for (std::uint64_t k = 0; k < inert; ++k) {
+			std::uint64_t n = 0;
+			if (!next(n) || n > count) return false;
+			std::vector<Vec3> poly(static_cast<size_t>(n));
+			for (auto& v : poly) {
+				if (!vec(v)) return false;
+			}
+			in.inertPolygons.push_back(std::move(poly));
+		}
+		return i == count;
+	}
+
+	static bool decode(const std::shared_ptr<const MappedFile>& file, TracedRun& run) {
+		if (file->size() < sizeof(RunFileHeader)) return false;
+		RunFileHeader h;
+		std::memcpy(&h, file->data(), sizeof(h));
+		if (h.magic != kRunFileMagic || h.version != kRunFileVersion || h.fileSize != file->size()) return false;
+		auto fits = [&h](std::uint64_t offset, std::uint64_t count, std::uint64_t elementSize) {
+			return offset % 8 == 0 && offset <= h.fileSize && count <= (h.fileSize - offset) / elementSize;
+		};
+		if (!fits(h.sceneOffset, h.sceneBytes / 8, 8) || !fits(h.pointsOffset, h.numPoints, sizeof(ReceiverPoint)) ||
+		    !fits(h.rowStartOffset, h.numPoints + 1, sizeof(std::uint64_t)) ||
+		    !fits(h.emitterOffset, h.numEntries, sizeof(std::uint32_t)) ||
+		    !fits(h.hitsOffset, h.numEntries, sizeof(std::uint32_t)) || !fits(h.rngOffset, h.rngBytes, 1)) {
+			return false;
+		}
+		const unsigned char* base = file->data();
+		JsonInput& in = run.input;
+		if (!decodeScene(reinterpret_cast<const std::uint64_t*>(base + h.sceneOffset), static_cast<size_t>(h.sceneBytes / 8), in)) return false;
+		if (in.polygons.size() != h.numEmitters) return false;
+		in.receiverPoints.resize(static_cast<size_t>(h.numPoints));
+		std::memcpy(in.receiverPoints.data(), base + h.pointsOffset, static_cast<size_t>(h.numPoints) * sizeof(ReceiverPoint));
+		in.numRays = static_cast<size_t>(h.numRays);
+		if (h.hasSeed) in.seed = h.seed;
+		in.pointIndexOffset = static_cast<size_t>(h.pointIndexOffset);
+		in.reuseResults = h.reuseResults != 0;
+		std::istringstream rngText(std::string(reinterpret_cast<const char*>(base + h.rngOffset), static_cast<size_t>(h.rngBytes)));
+		if (!(rngText >> run.rng)) return false;
+
+		// Indices are checked once here so the row readers never go out of bounds
+		ViewFactorMatrix& vf = run.viewFactors;
+		vf.numRays = static_cast<size_t>(h.numRays);
+		vf.numEmitters = static_cast<size_t>(h.numEmitters);
+		vf.mappedRowStart = reinterpret_cast<const std::uint64_t*>(base + h.rowStartOffset);
+		vf.mappedEmitter = reinterpret_cast<const std::uint32_t*>(base + h.emitterOffset);
+		vf.mappedHits = reinterpret_cast<const std::uint32_t*>(base + h.hitsOffset);
+		vf.mappedRows = static_cast<size_t>(h.numPoints);
+		if (vf.mappedRowStart[0] != 0 || vf.mappedRowStart[h.numPoints] != h.numEntries) return false;
+		for (std::uint64_t r = 0; r < h.numPoints; ++r) {
+			if (vf.mappedRowStart[r] > vf.mappedRowStart[r + 1]) return false;
+		}
+		for (std::uint64_t k = 0; k < h.numEntries; ++k) {
+			if (vf.mappedEmitter[k] >= h.numEmitters) return false;
+		}
+		vf.mapped = file;
+		return true;
+	}
+
+	std::mutex mutex_; // serialises renames and trimming
+	std::string dir_;
+	size_t budget_ {4096u << 20};
+	std::atomic<std::uint64_t> loads_ {0};
+	std::atomic<std::uint64_t> writes_ {0};
+	std::atomic<std::uint64_t> rejected_ {0};
+};
+
+static RunStore g_runStore;
+
+// Kept runs by key: memory first, then the run store (which moves it back into memory)
+static std::shared_ptr<const TracedRun> findTracedRun(const std::string& key) {
+	if (auto run = g_tracedRuns.find(key)) return run;
+	auto loaded = g_runStore.load(key);
+	if (!loaded) return nullptr;
+	const size_t bytes = loaded->bytes();
+	g_tracedRuns.insert(key, loaded, bytes);
+	return loaded;
+}
+
+// Keeps a completed trace addressable by its geometry key. Returns the key, or "" if the matrix
+// does not cover every receiver point (e.g. traced outside this process).
+static std::string rememberTracedRun(JsonInput&& in, ViewFactorMatrix&& viewFactors, const std::mt19937_64& rng) {
+	if (viewFactors.rows() != in.receiverPoints.size() || viewFactors.numEmitters != in.polygons.size()) return "";
+	const std::string key = computeGeometryKey(in);
+	auto run = std::make_shared<TracedRun>();
+	run->input = std::move(in);
+	run->viewFactors = std::move(viewFactors);
+	run->rng = rng;
+	const size_t bytes = run->bytes();
+	g_runStore.save(key, *run);
+	g_tracedRuns.insert(key, std::move(run), bytes);
+	return key;
+}
+
+// Recomputes every receiver grid of a traced run for new emitter temperatures, without tracing
+static PlaneResults reweightTracedRun(const TracedRun& run, const std::vector<double>& temperatures) {
+	PlaneResults planes;
+	size_t row = 0;
+	for (const auto& kv : run.input.planeDataMap) {
+		PlaneResult plane {kv.first, kv.second, {}};
+		plane.values.reserve(kv.second.numPoints);
+		for (size_t k = 0; k < kv.second.numPoints && row < run.viewFactors.rows(); ++k, ++row) {
+			plane.values.push_back(run.viewFactors.weightRow(row, temperatures.data()));
+		}
+		planes.push_back(std::move(plane));
+	}
+	return planes;
+}
+
+// ===== Incremental recomputation against a prior run =====
+
+struct Aabb {
+	Vec3 lo {std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity()};
+	Vec3 hi {-std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity()};
+
+	void add(const Vec3& p) {
+		lo = {std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z)};
+		hi = {std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z)};
+	}
+	bool overlaps(const Aabb& o, double pad) const {
+		return lo.x - pad <= o.hi.x && o.lo.x - pad <= hi.x && lo.y - pad <= o.hi.y && o.lo.y - pad <= hi.y &&
+		       lo.z - pad <= o.hi.z && o.lo.z - pad <= hi.z;
+	}
+};
+
+static Aabb boundsOf(const std::vector<Vec3>& vertices) {
+	Aabb box;
+	for (const auto& v : vertices) box.add(v);
+	return box;
+}
+
+static constexpr double kIncrementalPad = 1e-6;
+
+// Rays leave a point into its front hemisphere only, so a polygon wholly behind it is never hit
+static bool reachesFrontHalfSpace(const std::vector<Vec3>& vertices, const ReceiverPoint& rp) {
+	const Vec3 n = normalize(rp.normal);
+	for (const auto& v : vertices) {
+		if (dot(n, v - rp.origin) > -kIncrementalPad) return true;
+	}
+	return false;
+}
+
+static inline bool sameVec3(const Vec3& a, const Vec3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+static bool sameVertices(const std::vector<Vec3>& a, const std::vector<Vec3>& b) {
+	if (a.size() != b.size()) return false;
+	for (size_t k = 0; k < a.size(); ++k) {
+		if (!sameVec3(a[k], b[k])) return false;
+	}
+	return true;
+}
+
+// Which receiver points of a request must be re-traced, given a prior run of the same receivers
+struct IncrementalPlan {
+	std::shared_ptr<const TracedRun> base;
+	std::vector<char> retrace; // per global point index
+	size_t retraceCount {0};
+};
+
+// Returns false (full trace needed) unless the request differs from the base only in polygon
+// vertices and temperatures. A point is kept when no moved polygon can touch its rays:
+//   - a moved emitter matters if its old or new position reaches the point's front half-space;
+//   - a moved inert polygon can only block (or stop blocking) a ray on its way to an emitter, i.e.
+//     inside the hull of the point and that emitter, so it matters if its old or new bounds overlap
+//     the bounds of the point plus any emitter in front of it.
+static bool planIncremental(const JsonInput& in, IncrementalPlan& plan) {
+	plan.base = findTracedRun(in.baseKey);
+	if (!plan.base) return false;
+	const JsonInput& old = plan.base->input;
+	if (old.numRays != in.numRays || old.seed != in.seed || old.pointIndexOffset != in.pointIndexOffset) return false;
+	if (old.polygons.size() != in.polygons.size() || old.inertPolygons.size() != in.inertPolygons.size()) return false;
+	if (old.receiverPoints.size() != in.receiverPoints.size() || old.planeDataMap.size() != in.planeDataMap.size()) return false;
+	for (auto a = old.planeDataMap.begin(), b = in.planeDataMap.begin(); a != old.planeDataMap.end(); ++a, ++b) {
+		if (a->first != b->first || a->second.numPoints != b->second.numPoints || a->second.width != b->second.width ||
+		    a->second.height != b->second.height) {
+			return false;
+		}
+	}
+	for (size_t k = 0; k < in.receiverPoints.size(); ++k) {
+		if (!sameVec3(old.receiverPoints[k].origin, in.receiverPoints[k].origin) ||
+		    !sameVec3(old.receiverPoints[k].normal, in.receiverPoints[k].normal)) {
+			return false;
+		}
+	}
+
+	std::vector<size_t> movedEmitters;
+	for (size_t p = 0; p < in.polygons.size(); ++p) {
+		if (!sameVertices(old.polygons[p].vertices, in.polygons[p].vertices)) movedEmitters.push_back(p);
+	}
+	std::vector<Aabb> movedInertBounds;
+	for (size_t p = 0; p < in.inertPolygons.size(); ++p) {
+		if (sameVertices(old.inertPolygons[p], in.inertPolygons[p])) continue;
+		movedInertBounds.push_back(boundsOf(old.inertPolygons[p]));
+		movedInertBounds.push_back(boundsOf(in.inertPolygons[p]));
+	}
+	std::vector<Aabb> emitterBounds;
+	for (const auto& poly : in.polygons) emitterBounds.push_back(boundsOf(poly.vertices));
+
+	plan.retrace.assign(in.receiverPoints.size(), 0);
+	plan.retraceCount = 0;
+	for (size_t k = 0; k < in.receiverPoints.size(); ++k) {
+		const ReceiverPoint& rp = in.receiverPoints[k];
+		bool affected = false;
+		for (size_t p : movedEmitters) {
+			if (reachesFrontHalfSpace(old.polygons[p].vertices, rp) || reachesFrontHalfSpace(in.polygons[p].vertices, rp)) {
+				affected = true;
+				break;
+			}
+		}
+		for (size_t e = 0; !affected && !movedInertBounds.empty() && e < in.polygons.size(); ++e) {
+			if (!reachesFrontHalfSpace(in.polygons[e].vertices, rp)) continue;
+			Aabb sight = emitterBounds[e];
+			sight.add(rp.origin);
+			for (const auto& moved : movedInertBounds) {
+				if (sight.overlaps(moved, kIncrementalPad)) {
+					affected = true;
+					break;
+				}
+			}
+		}
+		plan.retrace[k] = affected ? 1 : 0;
+		if (affected) ++plan.retraceCount;
+	}
+	return true;
+}
+
+static std::atomic<std::uint64_t> g_incrementalRuns {0};
+static std::atomic<std::uint64_t> g_incrementalPointsReused {0};
+
+// Invoked once per receiver plane after its grid has been computed. Return false to stop processing.
+using ReceiverPlaneDoneFn = std::function<bool(
+    const std::string& planeName,
+    const PlaneData& planeData,
+    const std::vector<double>& planeTemperatures,
+    size_t planeIndex1Based,
+    size_t totalPlanes)>;
+
+// Snapshot of a running calculation, reported at most every kProgressIntervalMs
+struct ProgressInfo {
+	size_t pointsDone;
+	size_t totalPoints;
+	std::uint64_t raysTraced;
+	double elapsedSeconds;
+	double raysPerSecond;
+	double etaSeconds; // remaining rays / measured rate; negative until a rate is known
+	size_t planeIndex1Based;
+	size_t totalPlanes;
+};
+
+// Invoked from the compute loop with throttled progress. Return false to stop processing.
+using ProgressFn = std::function<bool(const ProgressInfo& progress)>;
+
+// Invoked as each row of width points of a plane completes, with the plane's values so far. Return
+// false to stop processing.
+using PlaneRowsFn = std::function<bool(
+    const std::string& planeName,
+    const PlaneData& planeData,
+    const std::vector<double>& valuesSoFar,
+    size_t planeIndex1Based,
+    size_t totalPlanes)>;
+
+static constexpr long long kProgressIntervalMs = 250;
+
+// Returns false if a callback asked to stop or the cancel token (may be null) fired. If viewFactorsOut
+// is given, each point's per-emitter hit counts are appended to it. With an incremental plan, points
+// it does not mark for re-tracing take their hit counts from the base run.
+static bool processReceiverPlanes(JsonInput& in, std::mt19937_64& rng, CancelToken* cancel, const ReceiverPlaneDoneFn& onPlaneDone,
+                                  const ProgressFn& onProgress = nullptr, ViewFactorMatrix* viewFactorsOut = nullptr,
+                                  const IncrementalPlan* incremental = nullptr, const PlaneRowsFn& onRows = nullptr) {
+	size_t globalPointIdx = 0;
+	size_t raysSinceCancelCheck = 0;
+	const size_t totalPlanes = in.planeDataMap.size();
+	size_t planeIndex = 0;
+
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point startTime = Clock::now();
+	Clock::time_point nextProgressAt = startTime + std::chrono::milliseconds(kProgressIntervalMs);
+	auto reportProgress = [&](Clock::time_point now) -> bool {
+		ProgressInfo p;
+		p.pointsDone = globalPointIdx;
+		p.totalPoints = in.receiverPoints.size();
+		p.raysTraced = static_cast<std::uint64_t>(globalPointIdx) * in.numRays;
+		p.elapsedSeconds = std::chrono::duration<double>(now - startTime).count();
+		p.raysPerSecond = p.elapsedSeconds > 0.0 ? static_cast<double>(p.raysTraced) / p.elapsedSeconds : 0.0;
+		const double raysLeft = static_cast<double>(p.totalPoints - std::min(p.pointsDone, p.totalPoints)) * in.numRays;
+		p.etaSeconds = p.raysPerSecond > 0.0 ? raysLeft / p.raysPerSecond : -1.0;
+		p.planeIndex1Based = planeIndex;
+		p.totalPlanes = totalPlanes;
+		return onProgress(p);
+	};
+
+	// Planes, projections and temperatures are prepared once per job, not per point
+	std::shared_ptr<const CompiledScene> scene = in.compiledScene;
+	if (!scene) scene = std::make_shared<const CompiledScene>(compileScene(in.polygons, in.inertPolygons));
+	const SceneView sceneView = scene->view();
+	std::vector<std::size_t> hitScratch;
+	if (viewFactorsOut) {
+		*viewFactorsOut = ViewFactorMatrix();
+		viewFactorsOut->numRays = in.numRays;
+		viewFactorsOut->numEmitters = in.polygons.size();
+		// Counts are stored as 32-bit; larger ray counts are simply not kept
+		if (in.numRays == 0 || in.numRays > std::numeric_limits<std::uint32_t>::max()) viewFactorsOut = nullptr;
+	}
+
+	std::cout << "=== Processing " << totalPlanes << " receiver planes ===" << std::endl;
+	std::cout << "Total receiver points: " << in.receiverPoints.size() << std::endl;
+	if (incremental) {
+		hitScratch.resize(sceneView.numEmitters);
+		std::cout << "Incremental: re-tracing " << incremental->retraceCount << " of " << in.receiverPoints.size() << " points" << std::endl;
+	}
+
+	for (const auto& planePair : in.planeDataMap) {
+		const std::string& planeName = planePair.first;
+		const PlaneData& planeData = planePair.second;
+		++planeIndex;
+
+		std::cout << "Processing plane: \"" << planeName << "\"" << std::endl;
+		std::cout << "  Grid: " << planeData.width << "x" << planeData.height << std::endl;
+		std::cout << "  Num points: " << planeData.numPoints << std::endl;
+		std::cout << "  Starting at globalPointIdx: " << globalPointIdx << std::endl;
+
+		if (globalPointIdx < in.receiverPoints.size()) {
+			const auto& firstPoint = in.receiverPoints[globalPointIdx];
+			std::cout << "  Sample point 0 origin: [" << firstPoint.origin.x << ", " << firstPoint.origin.y << ", " << firstPoint.origin.z << "]" << std::endl;
+			std::cout << "  Sample point 0 normal: [" << firstPoint.normal.x << ", " << firstPoint.normal.y << ", " << firstPoint.normal.z << "]" << std::endl;
+		}
+
+		std::cout << "  Number of emitters: " << in.polygons.size() << std::endl;
+		for (size_t i = 0; i < in.polygons.size(); ++i) {
+			std::cout << "    Emitter " << i << ": temp=" << in.polygons[i].temperature << ", vertices=" << in.polygons[i].vertices.size() << std::endl;
+			if (in.polygons[i].vertices.size() > 0) {
+				std::cout << "      First vertex: [" << in.polygons[i].vertices[0].x << ", " << in.polygons[i].vertices[0].y << ", " << in.polygons[i].vertices[0].z << "]" << std::endl;
+			}
+		}
+
+		std::vector<double> planeTemperatures;
+		planeTemperatures.reserve(planeData.numPoints);
+		const size_t rowPoints = planeTileColumns(planeData);
 
 		double minTemp = std::numeric_limits<double>::infinity();
 		double maxTemp = -std::numeric_limits<double>::infinity();
 
-		for (size_t localIdx = 0; localIdx < planeData.numPoints; ++localIdx) {
-			if (globalPointIdx >= in.receiverPoints.size()) {
-				std::cerr << "ERROR: globalPointIdx " << globalPointIdx << " exceeds receiverPoints size " << in.receiverPoints.size() << std::endl;
+		for (size_t localIdx = 0; localIdx < planeData.numPoints; ++localIdx) {
+			if (globalPointIdx >= in.receiverPoints.size()) {
+				std::cerr << "ERROR: globalPointIdx " << globalPointIdx << " exceeds receiverPoints size " << in.receiverPoints.size() << std::endl;
+				break;
+			}
+
+			const auto& receiverPoint = in.receiverPoints[globalPointIdx];
+
+			std::mt19937_64 pointRng = rng;
+			if (in.seed.has_value()) {
+				pointRng.seed(receiverPointSeed(in.seed.value(), in.pointIndexOffset + globalPointIdx));
+			}
+
+			double totalTemperature = 0.0;
+			if (incremental && !incremental->retrace[globalPointIdx]) {
+				incremental->base->viewFactors.expandRow(globalPointIdx, hitScratch.data());
+				totalTemperature = weightHitCounts(sceneView, in.numRays, hitScratch.data());
+			} else if (!tracePointTemperature(sceneView, receiverPoint, in.numRays, pointRng, cancel, hitScratch, totalTemperature)) {
+				std::cout << "  Cancelled in plane \"" << planeName << "\" at point " << localIdx << ": " << cancel->why() << std::endl;
+				return false;
+			} else {
+				// Small ray counts never reach the in-kernel check, so also poll between points
+				raysSinceCancelCheck += in.numRays;
+			}
+			if (cancel && raysSinceCancelCheck >= kCancelCheckRays) {
+				raysSinceCancelCheck = 0;
+				if (cancel->poll()) {
+					std::cout << "  Cancelled in plane \"" << planeName << "\" at point " << localIdx << ": " << cancel->why() << std::endl;
+					return false;
+				}
+			}
+
+			planeTemperatures.push_back(totalTemperature);
+			if (viewFactorsOut) viewFactorsOut->appendRow(hitScratch.data());
+
+			if (totalTemperature < minTemp) minTemp = totalTemperature;
+			if (totalTemperature > maxTemp) maxTemp = totalTemperature;
+
+			globalPointIdx++;
+
+			if (onRows && planeTemperatures.size() % rowPoints == 0 &&
+			    !onRows(planeName, planeData, planeTemperatures, planeIndex, totalPlanes)) {
+				return false;
+			}
+
+			// One clock read per point is noise next to tracing numRays rays
+			if (onProgress) {
+				const Clock::time_point now = Clock::now();
+				if (now >= nextProgressAt) {
+					nextProgressAt = now + std::chrono::milliseconds(kProgressIntervalMs);
+					if (!reportProgress(now)) return false;
+				}
+			}
+		}
+
+		std::cout << "  Finished plane \"" << planeName << "\"" << std::endl;
+		std::cout << "    Temperature range: " << minTemp << " to " << maxTemp << std::endl;
+		std::cout << "    Next globalPointIdx: " << globalPointIdx << std::endl;
+
+		if (!onPlaneDone(planeName, planeData, planeTemperatures, planeIndex, totalPlanes)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// ===== Progressive refinement =====
+
+// Independent stream per (point, round) so refining one plane never shifts another's samples
+static inline std::uint64_t progressiveBatchSeed(std::uint64_t seed, size_t globalPointIndex, size_t round) {
+	auto mix = [](std::uint64_t z) {
+		z += 0x9e3779b97f4a7c15ull;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	};
+	return mix(seed ^ mix(static_cast<std::uint64_t>(globalPointIndex) ^ mix(static_cast<std::uint64_t>(round))));
+}
+
+// Where a progressive run stands after a plane or a round; maxStdErr covers what was just refined
+struct RefinementStatus {
+	size_t round;
+	std::uint64_t raysPerPoint;
+	double maxStdErr;
+	double elapsedSeconds;
+};
+
+using PlaneRefinedFn = std::function<bool(const std::string& planeName, const PlaneData& planeData, const std::vector<double>& values,
+                                          size_t planeIndex1Based, size_t totalPlanes, const RefinementStatus& status)>;
+using RoundDoneFn = std::function<bool(const RefinementStatus& status)>;
+
+// Each ray adds T_e for the emitter it reaches (0 if none), so per point the estimate is the mean of
+// those samples and its standard error is sqrt((E[X^2] - E[X]^2) / N). Returns false if cancelled or
+// a callback asked to stop; stopReason is "rays", "deadline" or "tolerance" otherwise.
+static bool processReceiverPlanesProgressive(JsonInput& in, std::mt19937_64& rng, CancelToken* cancel, const PlaneRefinedFn& onPlane,
+                                             const RoundDoneFn& onRound, std::string& stopReason) {
+	const ProgressiveOptions opts = in.progressive.value_or(ProgressiveOptions());
+	const std::uint64_t seed = in.seed.has_value() ? in.seed.value() : rng();
+	std::shared_ptr<const CompiledScene> scene = in.compiledScene;
+	if (!scene) scene = std::make_shared<const CompiledScene>(compileScene(in.polygons, in.inertPolygons));
+	const SceneView sceneView = scene->view();
+
+	const size_t totalPoints = in.receiverPoints.size();
+	const size_t totalPlanes = in.planeDataMap.size();
+	std::vector<double> sumT(totalPoints, 0.0), sumT2(totalPoints, 0.0);
+	std::vector<std::size_t> hitScratch(sceneView.numEmitters);
+
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point startTime = Clock::now();
+	const bool haveDeadline = opts.deadlineMs > 0.0;
+	const Clock::time_point deadline = startTime + std::chrono::microseconds(static_cast<long long>(opts.deadlineMs * 1000.0));
+	auto elapsed = [&]() { return std::chrono::duration<double>(Clock::now() - startTime).count(); };
+
+	std::uint64_t raysDone = 0;
+	size_t raysSinceCancelCheck = 0;
+	for (size_t round = 0; raysDone < in.numRays; ++round) {
+		const std::uint64_t target = round == 0 ? std::min<std::uint64_t>(opts.initialRays, in.numRays)
+		                                        : std::min<std::uint64_t>(raysDone * 2, in.numRays);
+		const std::uint64_t batch = target - raysDone;
+		double roundMaxStdErr = 0.0;
+		size_t globalPointIdx = 0;
+		size_t planeIndex = 0;
+
+		for (const auto& planePair : in.planeDataMap) {
+			++planeIndex;
+			const PlaneData& planeData = planePair.second;
+			std::vector<double> values;
+			values.reserve(planeData.numPoints);
+			double planeMaxStdErr = 0.0;
+			for (size_t localIdx = 0; localIdx < planeData.numPoints && globalPointIdx < totalPoints; ++localIdx, ++globalPointIdx) {
+				// The first pass always completes so every plane has an estimate
+				if (round > 0 && haveDeadline && Clock::now() >= deadline) {
+					stopReason = "deadline";
+					return true;
+				}
+				const ReceiverPoint& rp = in.receiverPoints[globalPointIdx];
+				std::mt19937_64 batchRng(progressiveBatchSeed(seed, in.pointIndexOffset + globalPointIdx, round));
+				if (!traceEmitterHits(sceneView, rp.origin, rp.normal, static_cast<size_t>(batch), batchRng, cancel, hitScratch.data())) {
+					return false;
+				}
+				// Early rounds trace fewer rays than the in-kernel check interval, so also poll between points
+				raysSinceCancelCheck += static_cast<size_t>(batch);
+				if (cancel && raysSinceCancelCheck >= kCancelCheckRays) {
+					raysSinceCancelCheck = 0;
+					if (cancel->poll()) return false;
+				}
+				for (size_t p = 0; p < sceneView.numEmitters; ++p) {
+					if (hitScratch[p] == 0) continue;
+					const double t = sceneView.emitters[p].temperature;
+					sumT[globalPointIdx] += static_cast<double>(hitScratch[p]) * t;
+					sumT2[globalPointIdx] += static_cast<double>(hitScratch[p]) * t * t;
+				}
+				const double n = static_cast<double>(target);
+				const double mean = sumT[globalPointIdx] / n;
+				const double variance = std::max(0.0, sumT2[globalPointIdx] / n - mean * mean);
+				planeMaxStdErr = std::max(planeMaxStdErr, std::sqrt(variance / n));
+				values.push_back(mean);
+			}
+			roundMaxStdErr = std::max(roundMaxStdErr, planeMaxStdErr);
+			if (!onPlane(planePair.first, planeData, values, planeIndex, totalPlanes, {round, target, planeMaxStdErr, elapsed()})) {
+				return false;
+			}
+		}
+
+		raysDone = target;
+		std::cout << "Progressive round " << round << ": " << raysDone << " rays/point, max std err " << roundMaxStdErr << std::endl;
+		if (!onRound({round, raysDone, roundMaxStdErr, elapsed()})) return false;
+		if (opts.tolerance > 0.0 && roundMaxStdErr <= opts.tolerance) {
+			stopReason = "tolerance";
+			return true;
+		}
+		if (haveDeadline && Clock::now() >= deadline && raysDone < in.numRays) {
+			stopReason = "deadline";
+			return true;
+		}
+	}
+	stopReason = "rays";
+	return true;
+}
+
+// ===== Coordinator mode: shard receiver points across worker servers =====
+
+struct WorkerEndpoint {
+	std::string host;
+	int port;
+};
+
+struct ServerOptions {
+	int port {8080};
+	bool coordinator {false};
+	std::vector<WorkerEndpoint> workers;
+	size_t shardPoints {1024};
+	size_t processWorkers {0}; // > 0: trace in a pool of forked worker processes via shared memory
+	size_t cacheMemoryMb {256};
+	std::string cacheDir;      // empty: memory tier only
+	size_t cacheDiskMb {1024};
+	size_t viewFactorMb {512}; // traced runs kept for /reweight
+	std::string storeDir;      // empty: traced runs are lost on restart
+	size_t storeDiskMb {4096};
+	size_t resumeWindowSeconds {60}; // streams stay resumable (and orphaned jobs keep running) this long
+	size_t parseThreads {0};         // receiver points of one request parsed on this many threads; 0: one per core
+};
+
+static ServerOptions g_options;
+
+static size_t parseThreadCount() {
+	if (g_options.parseThreads > 0) return g_options.parseThreads;
+	return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+static constexpr int kMaxShardAttempts = 4;
+static constexpr int kWorkerFailuresBeforeDead = 3;
+static constexpr time_t kShardReadTimeoutSec = 900;
+
+// Scene plus points [first, first + count) as a normal request body, posted to a worker's /shard
+static std::string buildShardRequestJson(const JsonInput& in, size_t first, size_t count) {
+	std::ostringstream out;
+	out << std::setprecision(17);
+	auto vec = [&out](const Vec3& v) { out << "[" << v.x << "," << v.y << "," << v.z << "]"; };
+	auto polygon = [&](const std::vector<Vec3>& verts) {
+		out << "[";
+		for (size_t k = 0; k < verts.size(); ++k) {
+			if (k > 0) out << ",";
+			vec(verts[k]);
+		}
+		out << "]";
+	};
+
+	out << "{\"receiver_planes\":{\"shard\":{\"width\":" << count << ",\"height\":1,\"points\":[";
+	for (size_t k = 0; k < count; ++k) {
+		const ReceiverPoint& rp = in.receiverPoints[first + k];
+		if (k > 0) out << ",";
+		out << "{\"origin\":";
+		vec(rp.origin);
+		out << ",\"normal\":";
+		vec(rp.normal);
+		out << "}";
+	}
+	out << "]}},\"polygons\":[";
+	for (size_t p = 0; p < in.polygons.size(); ++p) {
+		if (p > 0) out << ",";
+		out << "{\"polygon\":";
+		polygon(in.polygons[p].vertices);
+		out << ",\"temperature\":" << in.polygons[p].temperature << "}";
+	}
+	out << "],\"inert_polygons\":[";
+	for (size_t p = 0; p < in.inertPolygons.size(); ++p) {
+		if (p > 0) out << ",";
+		polygon(in.inertPolygons[p]);
+	}
+	out << "],\"num_rays\":" << in.numRays;
+	if (in.seed.has_value()) out << ",\"seed\":" << in.seed.value();
+	out << ",\"point_offset\":" << (in.pointIndexOffset + first) << "}";
+	return out.str();
+}
+
+// Worker reply is {"success":true,"values":[...]}
+static bool parseShardResponse(const std::string& body, size_t expected, std::vector<double>& values) {
+	mini_json::Reader r(body);
+	bool haveValues = false;
+	values.clear();
+	values.reserve(expected);
+	const bool ok = r.object([&](std::string_view key) {
+		if (key != "values") return r.skipValue();
+		haveValues = true;
+		return r.array([&]() { return r.number(values.emplace_back()); });
+	});
+	return ok && haveValues && values.size() == expected;
+}
+
+// Same contract as processReceiverPlanes, but points are traced by g_options.workers. Shards are
+// retried on another worker when one fails; planes are re-stitched and reported in order.
+static bool processReceiverPlanesSharded(JsonInput& in, std::mt19937_64& rng, CancelToken* cancel, const ReceiverPlaneDoneFn& onPlaneDone,
+                                         const ProgressFn& onProgress = nullptr) {
+	// Per-point seeds make results independent of how points are split, so always send one
+	if (!in.seed.has_value()) in.seed = rng();
+
+	struct Shard {
+		size_t first;
+		size_t count;
+		int attempts {0};
+		std::vector<char> failedOn; // per worker
+		bool done {false};
+	};
+
+	const size_t totalPoints = in.receiverPoints.size();
+	const size_t numWorkers = g_options.workers.size();
+	const size_t shardSize = std::max<size_t>(1, g_options.shardPoints);
+
+	std::vector<Shard> shards;
+	for (size_t first = 0; first < totalPoints; first += shardSize) {
+		Shard sh;
+		sh.first = first;
+		sh.count = std::min(shardSize, totalPoints - first);
+		sh.failedOn.assign(numWorkers, 0);
+		shards.push_back(std::move(sh));
+	}
+
+	std::mutex m;
+	std::condition_variable cv;
+	std::deque<size_t> pending;
+	for (size_t k = 0; k < shards.size(); ++k) pending.push_back(k);
+	std::vector<double> values(totalPoints, 0.0);
+	std::vector<std::string> inFlightJobId(numWorkers);
+	size_t pointsDone = 0;
+	size_t aliveWorkers = numWorkers;
+	std::vector<char> workerAlive(numWorkers, 1);
+	bool stop = false;
+	std::string failure;
+
+	std::ostringstream prefix;
+	prefix << "shard-" << std::hex << rng();
+	const std::string jobPrefix = prefix.str();
+
+	std::cout << "=== Coordinating " << totalPoints << " receiver points as " << shards.size() << " shards over "
+	          << numWorkers << " workers ===" << std::endl;
+
+	// Prefer another worker; once every live worker has failed a shard, let them all try it again.
+	// Applied to every pending shard, since a worker dying can strand shards it never ran. Caller holds m.
+	auto releaseExhaustedShards = [&]() {
+		for (size_t k : pending) {
+			Shard& sh = shards[k];
+			bool exhausted = true;
+			for (size_t v = 0; v < numWorkers; ++v) {
+				if (workerAlive[v] && !sh.failedOn[v]) exhausted = false;
+			}
+			if (!exhausted) continue;
+			if (sh.attempts >= kMaxShardAttempts) {
+				failure = "shard " + std::to_string(k) + " failed on all attempts";
+				stop = true;
+				return;
+			}
+			for (size_t v = 0; v < numWorkers; ++v) sh.failedOn[v] = workerAlive[v] ? 0 : 1;
+		}
+	};
+
+	auto workerLoop = [&](size_t w) {
+		const WorkerEndpoint& endpoint = g_options.workers[w];
+		int consecutiveFailures = 0;
+		while (true) {
+			size_t shardIdx = 0;
+			std::string shardJobId;
+			{
+				std::unique_lock<std::mutex> lock(m);
+				cv.wait(lock, [&]() {
+					if (stop) return true;
+					for (size_t k : pending) if (!shards[k].failedOn[w]) return true;
+					return false;
+				});
+				if (stop) return;
+				auto it = std::find_if(pending.begin(), pending.end(), [&](size_t k) { return !shards[k].failedOn[w]; });
+				shardIdx = *it;
+				pending.erase(it);
+				++shards[shardIdx].attempts;
+				shardJobId = jobPrefix + "-" + std::to_string(shardIdx) + "-" + std::to_string(shards[shardIdx].attempts);
+				inFlightJobId[w] = shardJobId;
+			}
+
+			const Shard& sh = shards[shardIdx];
+			httplib::Client cli(endpoint.host, endpoint.port);
+			cli.set_connection_timeout(5, 0);
+			cli.set_read_timeout(kShardReadTimeoutSec, 0);
+			cli.set_write_timeout(60, 0);
+			const std::string body = buildShardRequestJson(in, sh.first, sh.count);
+			auto r = cli.Post("/shard", httplib::Headers{{"X-Job-Id", shardJobId}}, body, "application/json");
+
+			std::vector<double> shardValues;
+			const bool ok = r && r->status == 200 && parseShardResponse(r->body, sh.count, shardValues);
+
+			std::lock_guard<std::mutex> lock(m);
+			inFlightJobId[w].clear();
+			if (stop) return;
+			if (ok) {
+				consecutiveFailures = 0;
+				std::copy(shardValues.begin(), shardValues.end(), values.begin() + static_cast<std::ptrdiff_t>(sh.first));
+				shards[shardIdx].done = true;
+				pointsDone += sh.count;
+				cv.notify_all();
+				continue;
+			}
+
+			std::cerr << "Shard " << shardIdx << " failed on worker " << endpoint.host << ":" << endpoint.port << " ("
+			          << (r ? "HTTP " + std::to_string(r->status) : httplib::to_string(r.error())) << ")" << std::endl;
+			Shard& failed = shards[shardIdx];
+			failed.failedOn[w] = 1;
+			if (++consecutiveFailures >= kWorkerFailuresBeforeDead) {
+				std::cerr << "Worker " << endpoint.host << ":" << endpoint.port << " marked dead" << std::endl;
+				workerAlive[w] = 0;
+				--aliveWorkers;
+			}
+			if (failed.attempts >= kMaxShardAttempts || aliveWorkers == 0) {
+				failure = "shard " + std::to_string(shardIdx) + " failed on all attempts";
+				stop = true;
+			} else {
+				pending.push_front(shardIdx);
+				releaseExhaustedShards();
+			}
+			cv.notify_all();
+			if (stop || consecutiveFailures >= kWorkerFailuresBeforeDead) return;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t w = 0; w < numWorkers; ++w) threads.emplace_back(workerLoop, w);
+
+	auto cancelInFlight = [&]() {
+		std::vector<std::pair<size_t, std::string>> targets;
+		{
+			std::lock_guard<std::mutex> lock(m);
+			stop = true;
+			for (size_t w = 0; w < numWorkers; ++w) {
+				if (!inFlightJobId[w].empty()) targets.emplace_back(w, inFlightJobId[w]);
+			}
+		}
+		cv.notify_all();
+		for (const auto& t : targets) {
+			httplib::Client cli(g_options.workers[t.first].host, g_options.workers[t.first].port);
+			cli.set_connection_timeout(2, 0);
+			cli.Post("/jobs/" + t.second + "/cancel", "", "application/json");
+		}
+	};
+
+	// Emit planes in order as soon as every shard covering them is back
+	bool ok = true;
+	size_t planeIndex = 0;
+	size_t planeStart = 0;
+	size_t shardsReady = 0;
+	const size_t totalPlanes = in.planeDataMap.size();
+	auto planeIt = in.planeDataMap.begin();
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point startTime = Clock::now();
+	Clock::time_point nextProgressAt = startTime + std::chrono::milliseconds(kProgressIntervalMs);
+
+	while (planeIt != in.planeDataMap.end()) {
+		size_t readyPoints = 0;
+		size_t donePoints = 0;
+		{
+			std::unique_lock<std::mutex> lock(m);
+			cv.wait_for(lock, std::chrono::milliseconds(50));
+			if (stop) {
+				ok = false;
+				break;
+			}
+			while (shardsReady < shards.size() && shards[shardsReady].done) ++shardsReady;
+			readyPoints = shardsReady < shards.size() ? shards[shardsReady].first : totalPoints;
+			donePoints = pointsDone;
+		}
+		if (cancel && cancel->poll()) {
+			std::cout << "  Coordinator cancelled: " << cancel->why() << std::endl;
+			ok = false;
+			break;
+		}
+
+		while (planeIt != in.planeDataMap.end() && planeStart + planeIt->second.numPoints <= readyPoints) {
+			++planeIndex;
+			const PlaneData& pd = planeIt->second;
+			std::vector<double> planeTemperatures(values.begin() + static_cast<std::ptrdiff_t>(planeStart),
+			                                      values.begin() + static_cast<std::ptrdiff_t>(planeStart + pd.numPoints));
+			std::cout << "  Stitched plane \"" << planeIt->first << "\" (" << pd.numPoints << " points)" << std::endl;
+			if (!onPlaneDone(planeIt->first, pd, planeTemperatures, planeIndex, totalPlanes)) {
+				ok = false;
+				break;
+			}
+			planeStart += pd.numPoints;
+			++planeIt;
+		}
+		if (!ok) break;
+
+		const Clock::time_point now = Clock::now();
+		if (onProgress && now >= nextProgressAt) {
+			nextProgressAt = now + std::chrono::milliseconds(kProgressIntervalMs);
+			ProgressInfo p;
+			p.pointsDone = donePoints;
+			p.totalPoints = totalPoints;
+			p.raysTraced = static_cast<std::uint64_t>(donePoints) * in.numRays;
+			p.elapsedSeconds = std::chrono::duration<double>(now - startTime).count();
+			p.raysPerSecond = p.elapsedSeconds > 0.0 ? static_cast<double>(p.raysTraced) / p.elapsedSeconds : 0.0;
+			p.etaSeconds = p.raysPerSecond > 0.0 ? static_cast<double>(totalPoints - donePoints) * in.numRays / p.raysPerSecond : -1.0;
+			p.planeIndex1Based = std::min(planeIndex + 1, totalPlanes);
+			p.totalPlanes = totalPlanes;
+			if (!onProgress(p)) {
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	cancelInFlight();
+	for (auto& t : threads) t.join();
+	if (!failure.empty()) std::cerr << "Sharded calculation failed: " << failure << std::endl;
+	return ok && planeIt == in.planeDataMap.end();
+}
+
+#ifndef _WIN32
+// ===== Process pool: isolated worker processes tracing out of POSIX shared memory =====
+//
+// Each job gets one segment holding a ShmJobHeader, the compiled scene, the receiver points and a
+// double per point for results. Workers map it, trace the chunk of points they are told about over
+// a pipe ("JOB <segment> <first> <count>") and write results straight into the segment. A crashing
+// worker only fails the chunk it held (retried once on a fresh process); the server stays up.
+
+static constexpr std::uint64_t kShmJobMagic = 0x54524153484d4a31ULL; // "TRASHMJ1"
+static constexpr std::uint32_t kShmJobVersion = 1;
+static constexpr int kMaxChunkAttempts = 2;
+
+struct ShmJobHeader {
+	std::uint64_t magic;
+	std::uint32_t version;
+	std::uint32_t hasSeed;
+	std::uint64_t seed;
+	std::uint64_t numRays;
+	std::uint64_t pointIndexOffset;
+	std::uint64_t numEmitters;
+	std::uint64_t numInert;
+	std::uint64_t numVertices2d; // doubles, i.e. 2 per projected vertex
+	std::uint64_t numPoints;
+	std::uint64_t emittersOffset;
+	std::uint64_t inertOffset;
+	std::uint64_t verticesOffset;
+	std::uint64_t pointsOffset;
+	std::uint64_t outputOffset;
+	std::uint64_t totalBytes;
+	std::atomic<std::uint32_t> cancelled;
+	std::atomic<std::uint64_t> pointsDone;
+};
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free && std::atomic<std::uint64_t>::is_always_lock_free,
+              "shared-memory counters must be lock-free to work across processes");
+
+// RAII mapping of a named POSIX shared-memory object; the creator unlinks it
+class ShmSegment {
+public:
+	ShmSegment() = default;
+	~ShmSegment() { close(); }
+	ShmSegment(const ShmSegment&) = delete;
+	ShmSegment& operator=(const ShmSegment&) = delete;
+
+	bool create(const std::string& name, size_t size) {
+		int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd < 0) return false;
+		if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+			::close(fd);
+			shm_unlink(name.c_str());
+			return false;
+		}
+		return map(fd, name, size, true);
+	}
+	bool open(const std::string& name) {
+		int fd = shm_open(name.c_str(), O_RDWR, 0600);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+			::close(fd);
+			return false;
+		}
+		return map(fd, name, static_cast<size_t>(st.st_size), false);
+	}
+	void close() {
+		if (data_) munmap(data_, size_);
+		if (owner_) shm_unlink(name_.c_str());
+		data_ = nullptr;
+		size_ = 0;
+		owner_ = false;
+	}
+	unsigned char* data() const { return static_cast<unsigned char*>(data_); }
+	size_t size() const { return size_; }
+	const std::string& name() const { return name_; }
+
+private:
+	bool map(int fd, const std::string& name, size_t size, bool owner) {
+		void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) {
+			if (owner) shm_unlink(name.c_str());
+			return false;
+		}
+		data_ = p;
+		size_ = size;
+		name_ = name;
+		owner_ = owner;
+		return true;
+	}
+
+	void* data_ {nullptr};
+	size_t size_ {0};
+	std::string name_;
+	bool owner_ {false};
+};
+
+static size_t alignShm(size_t offset) { return (offset + 63) & ~static_cast<size_t>(63); }
+
+// Lays the compiled scene and receiver points out in a fresh segment; output starts zeroed
+static bool buildShmJob(const JsonInput& in, const std::string& name, ShmSegment& seg) {
+	const CompiledScene scene = compileScene(in.polygons, in.inertPolygons);
+	size_t offset = alignShm(sizeof(ShmJobHeader));
+	const size_t emittersOffset = offset;
+	offset = alignShm(offset + scene.emitters.size() * sizeof(CompiledPolygon));
+	const size_t inertOffset = offset;
+	offset = alignShm(offset + scene.inert.size() * sizeof(CompiledPolygon));
+	const size_t verticesOffset = offset;
+	offset = alignShm(offset + scene.vertices2d.size() * sizeof(double));
+	const size_t pointsOffset = offset;
+	offset = alignShm(offset + in.receiverPoints.size() * sizeof(ReceiverPoint));
+	const size_t outputOffset = offset;
+	offset = alignShm(offset + in.receiverPoints.size() * sizeof(double));
+
+	if (!seg.create(name, offset)) return false;
+	unsigned char* base = seg.data();
+	ShmJobHeader* hdr = new (base) ShmJobHeader();
+	hdr->magic = kShmJobMagic;
+	hdr->version = kShmJobVersion;
+	hdr->hasSeed = in.seed.has_value() ? 1 : 0;
+	hdr->seed = in.seed.value_or(0);
+	hdr->numRays = in.numRays;
+	hdr->pointIndexOffset = in.pointIndexOffset;
+	hdr->numEmitters = scene.emitters.size();
+	hdr->numInert = scene.inert.size();
+	hdr->numVertices2d = scene.vertices2d.size();
+	hdr->numPoints = in.receiverPoints.size();
+	hdr->emittersOffset = emittersOffset;
+	hdr->inertOffset = inertOffset;
+	hdr->verticesOffset = verticesOffset;
+	hdr->pointsOffset = pointsOffset;
+	hdr->outputOffset = outputOffset;
+	hdr->totalBytes = offset;
+	hdr->cancelled.store(0);
+	hdr->pointsDone.store(0);
+	if (!scene.emitters.empty()) std::memcpy(base + emittersOffset, scene.emitters.data(), scene.emitters.size() * sizeof(CompiledPolygon));
+	if (!scene.inert.empty()) std::memcpy(base + inertOffset, scene.inert.data(), scene.inert.size() * sizeof(CompiledPolygon));
+	if (!scene.vertices2d.empty()) std::memcpy(base + verticesOffset, scene.vertices2d.data(), scene.vertices2d.size() * sizeof(double));
+	if (!in.receiverPoints.empty()) std::memcpy(base + pointsOffset, in.receiverPoints.data(), in.receiverPoints.size() * sizeof(ReceiverPoint));
+	return true;
+}
+
+static bool writeAll(int fd, const std::string& msg) {
+	size_t off = 0;
+	while (off < msg.size()) {
+		ssize_t n = ::write(fd, msg.data() + off, msg.size() - off);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		off += static_cast<size_t>(n);
+	}
+	return true;
+}
+
+// Entry point of a pool worker process (exec'd with --shm-worker <cmdFd> <resultFd>)
+static int runShmWorkerProcess(int cmdFd, int resultFd) {
+	// The parent decides when workers stop; Ctrl+C in the terminal must not kill jobs mid-chunk
+	std::signal(SIGINT, SIG_IGN);
+	std::signal(SIGTERM, SIG_IGN);
+	std::string buffer;
+	char chunk[512];
+	std::vector<std::size_t> hitScratch;
+	while (true) {
+		size_t nl;
+		while ((nl = buffer.find('\n')) == std::string::npos) {
+			ssize_t n = ::read(cmdFd, chunk, sizeof(chunk));
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return 0; // parent closed the pipe: pool shutting down
+			buffer.append(chunk, static_cast<size_t>(n));
+		}
+		const std::string line = buffer.substr(0, nl);
+		buffer.erase(0, nl + 1);
+
+		std::istringstream cmd(line);
+		std::string verb, name;
+		std::uint64_t first = 0, count = 0;
+		cmd >> verb >> name >> first >> count;
+		bool ok = false;
+		ShmSegment seg;
+		if (verb == "JOB" && seg.open(name) && seg.size() >= sizeof(ShmJobHeader)) {
+			unsigned char* base = seg.data();
+			ShmJobHeader* hdr = reinterpret_cast<ShmJobHeader*>(base);
+			if (hdr->magic == kShmJobMagic && hdr->version == kShmJobVersion && hdr->totalBytes <= seg.size() &&
+			    first + count <= hdr->numPoints) {
+				const SceneView view {
+					reinterpret_cast<const CompiledPolygon*>(base + hdr->emittersOffset), static_cast<size_t>(hdr->numEmitters),
+					reinterpret_cast<const CompiledPolygon*>(base + hdr->inertOffset), static_cast<size_t>(hdr->numInert),
+					reinterpret_cast<const double*>(base + hdr->verticesOffset)};
+				const ReceiverPoint* points = reinterpret_cast<const ReceiverPoint*>(base + hdr->pointsOffset);
+				double* output = reinterpret_cast<double*>(base + hdr->outputOffset);
+				CancelToken cancel;
+				cancel.isConsumerAlive = [hdr]() { return hdr->cancelled.load(std::memory_order_relaxed) == 0; };
+				ok = true;
+				for (std::uint64_t k = first; k < first + count; ++k) {
+					std::mt19937_64 pointRng(receiverPointSeed(hdr->seed, static_cast<size_t>(hdr->pointIndexOffset + k)));
+					double total = 0.0;
+					if (!tracePointTemperature(view, points[k], static_cast<size_t>(hdr->numRays), pointRng, &cancel, hitScratch, total)) {
+						ok = false;
+						break;
+					}
+					output[k] = total;
+					hdr->pointsDone.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}
+		if (!writeAll(resultFd, std::string(ok ? "DONE " : "FAIL ") + std::to_string(first) + "\n")) return 0;
+	}
+}
+
+// Points of one job, split into chunks the pool hands to idle workers
+struct PoolJob {
+	std::string segmentName;
+	std::vector<std::pair<size_t, size_t>> chunks; // first point, count
+	std::vector<char> chunkDone;
+	std::vector<int> chunkAttempts;
+	std::deque<size_t> pending;
+	size_t inFlight {0};
+	bool cancelled {false};
+	std::string error; // non-empty once the job has failed
+};
+
+class ProcessPool {
+public:
+	bool start(size_t count, const std::string& exePath, std::string& error) {
+		exePath_ = exePath;
+		int wake[2];
+		if (!makePipe(wake)) { error = "pipe() failed"; return false; }
+		wakeRead_ = wake[0];
+		wakeWrite_ = wake[1];
+		fcntl(wakeRead_, F_SETFL, O_NONBLOCK);
+		fcntl(wakeWrite_, F_SETFL, O_NONBLOCK);
+		workers_.resize(count);
+		for (size_t w = 0; w < count; ++w) {
+			if (!spawn(workers_[w])) { error = "failed to start worker process"; return false; }
+		}
+		thread_ = std::thread([this]() { run(); });
+		return true;
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(m_);
+			if (stopping_) return;
+			stopping_ = true;
+			for (auto& job : jobs_) {
+				job->cancelled = true;
+				if (job->error.empty()) job->error = "server shutting down";
+			}
+		}
+		wake();
+		if (thread_.joinable()) thread_.join();
+		for (auto& w : workers_) {
+			if (w.cmdFd >= 0) ::close(w.cmdFd);
+			if (w.resultFd >= 0) ::close(w.resultFd);
+			if (w.pid > 0) waitpid(w.pid, nullptr, 0);
+		}
+		cv_.notify_all();
+	}
+
+	size_t size() const { return workers_.size(); }
+
+	void submit(const std::shared_ptr<PoolJob>& job) {
+		{
+			std::lock_guard<std::mutex> lock(m_);
+			if (stopping_) {
+				job->error = "server shutting down";
+			} else {
+				jobs_.push_back(job);
+			}
+		}
+		wake();
+	}
+
+	// Drops pending chunks; in-flight ones finish early because the segment's cancel flag is set
+	void cancel(const std::shared_ptr<PoolJob>& job) {
+		std::lock_guard<std::mutex> lock(m_);
+		job->cancelled = true;
+		job->pending.clear();
+		cv_.notify_all();
+	}
+
+	// Waits up to timeout for the pool to change state, then inspects the job under the pool lock
+	template <typename Fn>
+	void waitFor(const std::shared_ptr<PoolJob>& job, std::chrono::milliseconds timeout, Fn&& fn) {
+		std::unique_lock<std::mutex> lock(m_);
+		cv_.wait_for(lock, timeout);
+		fn(*job);
+	}
+
+	void waitIdle(const std::shared_ptr<PoolJob>& job) {
+		std::unique_lock<std::mutex> lock(m_);
+		cv_.wait(lock, [&]() { return job->inFlight == 0 || stopping_; });
+		jobs_.erase(std::remove(jobs_.begin(), jobs_.end(), job), jobs_.end());
+	}
+
+private:
+	struct Worker {
+		pid_t pid {-1};
+		int cmdFd {-1};
+		int resultFd {-1};
+		std::string readBuffer;
+		std::shared_ptr<PoolJob> job; // set while a chunk is in flight
+		size_t chunk {0};
+	};
+
+	static bool makePipe(int fds[2]) {
+		if (pipe(fds) != 0) return false;
+		// Parent-side ends must not leak into other workers, or a crash would never show up as EOF
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+		return true;
+	}
+
+	bool spawn(Worker& w) {
+		int cmd[2], res[2];
+		if (!makePipe(cmd)) return false;
+		if (!makePipe(res)) {
+			::close(cmd[0]);
+			::close(cmd[1]);
+			return false;
+		}
+		// Build argv before fork: only async-signal-safe calls are allowed in the child
+		const std::string cmdFdArg = std::to_string(cmd[0]);
+		const std::string resFdArg = std::to_string(res[1]);
+		char* argv[] = {const_cast<char*>(exePath_.c_str()), const_cast<char*>("--shm-worker"),
+		                const_cast<char*>(cmdFdArg.c_str()), const_cast<char*>(resFdArg.c_str()), nullptr};
+		pid_t pid = fork();
+		if (pid < 0) {
+			::close(cmd[0]); ::close(cmd[1]); ::close(res[0]); ::close(res[1]);
+			return false;
+		}
+		if (pid == 0) {
+			fcntl(cmd[0], F_SETFD, 0);
+			fcntl(res[1], F_SETFD, 0);
+			execv(exePath_.c_str(), argv);
+			_exit(127);
+		}
+		::close(cmd[0]);
+		::close(res[1]);
+		w.pid = pid;
+		w.cmdFd = cmd[1];
+		w.resultFd = res[0];
+		w.readBuffer.clear();
+		w.job.reset();
+		return true;
+	}
+
+	void wake() {
+		const char c = 1;
+		ssize_t ignored = ::write(wakeWrite_, &c, 1);
+		(void)ignored;
+	}
+
+	// Called with m_ held when a worker returns (or loses) its chunk
+	void finishChunk(Worker& w, bool ok, const char* failure) {
+		std::shared_ptr<PoolJob> job = std::move(w.job);
+		w.job.reset();
+		if (!job) return;
+		--job->inFlight;
+		if (ok) {
+			job->chunkDone[w.chunk] = 1;
+		} else if (!job->cancelled && job->error.empty()) {
+			if (++job->chunkAttempts[w.chunk] >= kMaxChunkAttempts) {
+				job->error = failure;
+				job->cancelled = true;
+				job->pending.clear();
+			} else {
+				job->pending.push_front(w.chunk);
+			}
+		}
+		cv_.notify_all();
+	}
+
+	void assignWork() {
+		if (jobs_.empty()) return;
+		for (auto& w : workers_) {
+			if (w.job || w.pid <= 0) continue;
+			// Round-robin over jobs so a huge job doesn't starve the others
+			for (size_t k = 0; k < jobs_.size(); ++k) {
+				auto& job = jobs_[(nextJob_ + k) % jobs_.size()];
+				if (job->cancelled || job->pending.empty()) continue;
+				const size_t chunk = job->pending.front();
+				job->pending.pop_front();
+				const auto& range = job->chunks[chunk];
+				w.job = job;
+				w.chunk = chunk;
+				++job->inFlight;
+				nextJob_ = (nextJob_ + k + 1) % jobs_.size();
+				const std::string msg = "JOB " + job->segmentName + " " + std::to_string(range.first) + " " +
+				                        std::to_string(range.second) + "\n";
+				if (!writeAll(w.cmdFd, msg)) handleCrash(w);
+				break;
+			}
+		}
+	}
+
+	void handleCrash(Worker& w) {
+		int status = 0;
+		if (w.pid > 0) waitpid(w.pid, &status, 0);
+		std::cerr << "Worker process " << w.pid << " died";
+		if (WIFSIGNALED(status)) std::cerr << " (signal " << WTERMSIG(status) << ")";
+		std::cerr << "; restarting it" << std::endl;
+		::close(w.cmdFd);
+		::close(w.resultFd);
+		w.pid = -1;
+		w.cmdFd = w.resultFd = -1;
+		finishChunk(w, false, "worker process crashed");
+		if (!stopping_ && !spawn(w)) std::cerr << "Could not restart worker process" << std::endl;
+	}
+
+	void run() {
+		while (true) {
+			std::vector<pollfd> fds;
+			{
+				std::lock_guard<std::mutex> lock(m_);
+				if (stopping_) break;
+				assignWork();
+				fds.push_back({wakeRead_, POLLIN, 0});
+				for (const auto& w : workers_) fds.push_back({w.resultFd, POLLIN, 0});
+			}
+			if (poll(fds.data(), fds.size(), 200) < 0 && errno != EINTR) break;
+			if (fds[0].revents & POLLIN) {
+				char drain[64];
+				while (::read(wakeRead_, drain, sizeof(drain)) > 0) {}
+			}
+			std::lock_guard<std::mutex> lock(m_);
+			for (size_t k = 0; k < workers_.size(); ++k) {
+				Worker& w = workers_[k];
+				if (w.resultFd < 0 || fds[k + 1].fd != w.resultFd || !(fds[k + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+				char buf[256];
+				ssize_t n = ::read(w.resultFd, buf, sizeof(buf));
+				if (n <= 0) {
+					if (n < 0 && errno == EINTR) continue;
+					handleCrash(w);
+					continue;
+				}
+				w.readBuffer.append(buf, static_cast<size_t>(n));
+				size_t nl;
+				while ((nl = w.readBuffer.find('\n')) != std::string::npos) {
+					const bool ok = w.readBuffer.compare(0, 5, "DONE ") == 0;
+					w.readBuffer.erase(0, nl + 1);
+					finishChunk(w, ok, "worker could not trace its chunk");
+				}
+			}
+		}
+	}
+
+	std::string exePath_;
+	std::vector<Worker> workers_;
+	std::vector<std::shared_ptr<PoolJob>> jobs_;
+	size_t nextJob_ {0};
+	std::mutex m_;
+	std::condition_variable cv_;
+	std::thread thread_;
+	int wakeRead_ {-1};
+	int wakeWrite_ {-1};
+	bool stopping_ {false};
+};
+
+static ProcessPool g_processPool;
+static std::atomic<std::uint64_t> g_shmJobCounter {0};
+
+// Same contract as processReceiverPlanes, but points are traced by the worker processes
+static bool processReceiverPlanesInPool(JsonInput& in, std::mt19937_64& rng, CancelToken* cancel, const ReceiverPlaneDoneFn& onPlaneDone,
+                                        const ProgressFn& onProgress = nullptr) {
+	// Workers seed every point themselves; unseeded requests get one seed for the whole job
+	if (!in.seed.has_value()) in.seed = rng();
+
+	ShmSegment seg;
+	const std::string name = "/tra-" + std::to_string(getpid()) + "-" + std::to_string(++g_shmJobCounter);
+	if (!buildShmJob(in, name, seg)) {
+		std::cerr << "Could not create shared-memory segment " << name << ": " << std::strerror(errno) << std::endl;
+		return false;
+	}
+	ShmJobHeader* hdr = reinterpret_cast<ShmJobHeader*>(seg.data());
+	const double* output = reinterpret_cast<const double*>(seg.data() + hdr->outputOffset);
+
+	const size_t totalPoints = in.receiverPoints.size();
+	const size_t chunkSize = std::min<size_t>(1024, std::max<size_t>(16, totalPoints / (g_processPool.size() * 8) + 1));
+	auto job = std::make_shared<PoolJob>();
+	job->segmentName = name;
+	for (size_t first = 0; first < totalPoints; first += chunkSize) {
+		job->chunks.emplace_back(first, std::min(chunkSize, totalPoints - first));
+		job->pending.push_back(job->chunks.size() - 1);
+	}
+	job->chunkDone.assign(job->chunks.size(), 0);
+	job->chunkAttempts.assign(job->chunks.size(), 0);
+
+	std::cout << "=== Tracing " << totalPoints << " receiver points in " << job->chunks.size() << " chunks on "
+	          << g_processPool.size() << " worker processes (" << name << ") ===" << std::endl;
+	g_processPool.submit(job);
+
+	bool ok = true;
+	size_t planeIndex = 0;
+	size_t planeStart = 0;
+	size_t chunksReady = 0;
+	const size_t totalPlanes = in.planeDataMap.size();
+	auto planeIt = in.planeDataMap.begin();
+	using Clock = std::chrono::steady_clock;
+	const Clock::time_point startTime = Clock::now();
+	Clock::time_point nextProgressAt = startTime + std::chrono::milliseconds(kProgressIntervalMs);
+
+	while (planeIt != in.planeDataMap.end()) {
+		size_t readyPoints = 0;
+		std::string error;
+		g_processPool.waitFor(job, std::chrono::milliseconds(50), [&](PoolJob& j) {
+			while (chunksReady < j.chunks.size() && j.chunkDone[chunksReady]) ++chunksReady;
+			readyPoints = chunksReady < j.chunks.size() ? j.chunks[chunksReady].first : totalPoints;
+			error = j.error;
+		});
+		if (!error.empty()) {
+			std::cerr << "Process-pool job failed: " << error << std::endl;
+			ok = false;
+			break;
+		}
+		if (cancel && cancel->poll()) {
+			std::cout << "  Cancelled: " << cancel->why() << std::endl;
+			ok = false;
+			break;
+		}
+
+		while (planeIt != in.planeDataMap.end() && planeStart + planeIt->second.numPoints <= readyPoints) {
+			++planeIndex;
+			const PlaneData& pd = planeIt->second;
+			std::vector<double> planeTemperatures(output + planeStart, output + planeStart + pd.numPoints);
+			if (!onPlaneDone(planeIt->first, pd, planeTemperatures, planeIndex, totalPlanes)) {
+				ok = false;
+				break;
+			}
+			planeStart += pd.numPoints;
+			++planeIt;
+		}
+		if (!ok) break;
+
+		const Clock::time_point now = Clock::now();
+		if (onProgress && now >= nextProgressAt) {
+			nextProgressAt = now + std::chrono::milliseconds(kProgressIntervalMs);
+			ProgressInfo p;
+			p.pointsDone = static_cast<size_t>(hdr->pointsDone.load(std::memory_order_relaxed));
+			p.totalPoints = totalPoints;
+			p.raysTraced = static_cast<std::uint64_t>(p.pointsDone) * in.numRays;
+			p.elapsedSeconds = std::chrono::duration<double>(now - startTime).count();
+			p.raysPerSecond = p.elapsedSeconds > 0.0 ? static_cast<double>(p.raysTraced) / p.elapsedSeconds : 0.0;
+			p.etaSeconds = p.raysPerSecond > 0.0 ? static_cast<double>(totalPoints - std::min(p.pointsDone, totalPoints)) * in.numRays / p.raysPerSecond : -1.0;
+			p.planeIndex1Based = std::min(planeIndex + 1, totalPlanes);
+			p.totalPlanes = totalPlanes;
+			if (!onProgress(p)) {
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	if (!ok) {
+		hdr->cancelled.store(1);
+		g_processPool.cancel(job);
+	}
+	g_processPool.waitIdle(job);
+	return ok;
+}
+#endif
+
+// Local engine, the remote workers in coordinator mode, or the local process pool
+// View factors are only captured, and rows only reported, when tracing in this process; other modes
+// leave viewFactorsOut empty and never call onRows.
+static bool runReceiverPlanes(JsonInput& in, std::mt19937_64& rng, CancelToken* cancel, const ReceiverPlaneDoneFn& onPlaneDone,
+                              const ProgressFn& onProgress = nullptr, ViewFactorMatrix* viewFactorsOut = nullptr,
+                              const PlaneRowsFn& onRows = nullptr) {
+	if (g_options.coordinator) return processReceiverPlanesSharded(in, rng, cancel, onPlaneDone, onProgress);
+#ifndef _WIN32
+	if (g_options.processWorkers > 0) return processReceiverPlanesInPool(in, rng, cancel, onPlaneDone, onProgress);
+#endif
+	// Same receivers as a kept run: only points an edit can reach are traced again
+	IncrementalPlan plan;
+	if (!in.baseKey.empty()) {
+		if (planIncremental(in, plan)) {
+			if (!in.seed.has_value()) rng = plan.base->rng;
+			++g_incrementalRuns;
+			g_incrementalPointsReused += in.receiverPoints.size() - plan.retraceCount;
+			return processReceiverPlanes(in, rng, cancel, onPlaneDone, onProgress, viewFactorsOut, &plan, onRows);
+		}
+		std::cout << "Base run " << in.baseKey << " not usable, tracing every point" << std::endl;
+	}
+	return processReceiverPlanes(in, rng, cancel, onPlaneDone, onProgress, viewFactorsOut, nullptr, onRows);
+}
+
+static std::string jsonEscapeStringValue(const std::string& s) {
+	std::string o;
+	o.reserve(s.size() + 8);
+	for (char c : s) {
+		if (c == '\\') {
+			o += "\\\\";
+		} else if (c == '"') {
+			o += "\\\"";
+		} else if (c == '\n') {
+			o += "\\n";
+		} else if (c == '\r') {
+			o += "\\r";
+		} else if (c == '\t') {
+			o += "\\t";
+		} else {
+			o += c;
+		}
+	}
+	return o;
+}
+
+// ===== Plane summaries and contours: numbers derived from a plane's values =====
+
+// Each plane's frame from its corner points, reading receiverPoints in plane-name order as the
+// tracer does. Points are taken to be evenly spaced, as the frontend and "grid" planes lay them
+// out. Only planes of width x height points get axes; the others keep just their origin.
+static std::shared_ptr<const GridFrames> computeGridFrames(const JsonInput& in) {
+	auto frames = std::make_shared<GridFrames>();
+	size_t first = 0;
+	for (const auto& kv : in.planeDataMap) {
+		const PlaneData& pd = kv.second;
+		GridFrame frame;
+		if (pd.numPoints > 0 && first + pd.numPoints <= in.receiverPoints.size()) {
+			const ReceiverPoint* points = in.receiverPoints.data() + first;
+			frame.origin = points[0].origin;
+			if (pd.width * pd.height == pd.numPoints) {
+				const size_t lastCol = pd.width - 1, lastRow = pd.height - 1;
+				if (lastCol > 0) frame.alongCols = (points[lastCol].origin - points[0].origin) / static_cast<double>(lastCol);
+				if (lastRow > 0) frame.alongRows = (points[lastRow * pd.width].origin - points[0].origin) / static_cast<double>(lastRow);
+			}
+		}
+		(*frames)[kv.first] = frame;
+		first += pd.numPoints;
+	}
+	return frames;
+}
+
+// Frames come from the request's points, which a run moves away; call before running
+static void prepareDerivedOutput(JsonInput& in) {
+	if (in.output.derived() && !in.output.frames) in.output.frames = computeGridFrames(in);
+}
+
+static const GridFrame* findGridFrame(const OutputOptions& output, const std::string& planeName) {
+	if (!output.frames) return nullptr;
+	auto it = output.frames->find(planeName);
+	return it == output.frames->end() ? nullptr : &it->second;
+}
+
+// Appends ,"summary":{...} to a plane's JSON object. Each point stands for the part of the plane
+// nearer to it than to the next points (trapezoid weights: half on an edge, a quarter in a corner),
+// so "area" is the whole plane and each "above" entry the area at or above its threshold.
+static void appendPlaneSummaryJson(std::string& out, const std::string& planeName, const PlaneData& planeData,
+                                   const std::vector<double>& values, const OutputOptions& output) {
+	const GridFrame* frame = findGridFrame(output, planeName);
+	const size_t cols = planeData.width, rows = planeData.height;
+	const bool grid = frame && cols > 0 && cols * rows == values.size();
+	const double cellArea = grid ? length(cross(frame->alongCols, frame->alongRows)) : 0.0;
+	auto edgeWeight = [](size_t i, size_t n) { return n < 2 ? 0.0 : i == 0 || i + 1 == n ? 0.5 : 1.0; };
+
+	const std::vector<double>& thresholds = output.thresholds;
+	std::vector<size_t> pointsAbove(thresholds.size(), 0);
+	std::vector<double> areaAbove(thresholds.size(), 0.0);
+	size_t count = 0, argMax = 0;
+	double lo = 0.0, hi = 0.0, sum = 0.0;
+	for (size_t i = 0; i < values.size(); ++i) {
+		const double v = values[i];
+		if (!std::isfinite(v)) continue;
+		if (count == 0 || v < lo) lo = v;
+		if (count == 0 || v > hi) {
+			hi = v;
+			argMax = i;
+		}
+		sum += v;
+		++count;
+		const double weight = grid ? cellArea * edgeWeight(i % cols, cols) * edgeWeight(i / cols, rows) : 0.0;
+		for (size_t t = 0; t < thresholds.size(); ++t) {
+			if (v < thresholds[t]) continue;
+			++pointsAbove[t];
+			areaAbove[t] += weight;
+		}
+	}
+
+	auto number = [&](double v) { appendJsonNumber(out, v, output.precision); };
+	out += ",\"summary\":{\"points\":";
+	out += std::to_string(count);
+	if (count == 0) {
+		out += ",\"min\":null,\"max\":null,\"mean\":null,\"argMax\":null";
+	} else {
+		out += ",\"min\":";
+		number(lo);
+		out += ",\"max\":";
+		number(hi);
+		out += ",\"mean\":";
+		number(sum / static_cast<double>(count));
+		out += ",\"argMax\":{\"index\":";
+		out += std::to_string(argMax);
+		if (grid) {
+			const size_t col = argMax % cols, row = argMax / cols;
+			const Vec3 at = frame->origin + frame->alongCols * static_cast<double>(col) + frame->alongRows * static_cast<double>(row);
+			out += ",\"col\":" + std::to_string(col) + ",\"row\":" + std::to_string(row) + ",\"point\":[";
+			number(at.x);
+			out += ',';
+			number(at.y);
+			out += ',';
+			number(at.z);
+			out += ']';
+		}
+		out += '}';
+	}
+	out += ",\"area\":";
+	if (grid) number(cellArea * static_cast<double>(cols - 1) * static_cast<double>(rows > 0 ? rows - 1 : 0));
+	else out += "null";
+	out += ",\"above\":[";
+	for (size_t t = 0; t < thresholds.size(); ++t) {
+		if (t > 0) out += ',';
+		out += "{\"threshold\":";
+		number(thresholds[t]);
+		out += ",\"points\":";
+		out += std::to_string(pointsAbove[t]);
+		out += ",\"area\":";
+		if (grid) number(areaAbove[t]);
+		else out += "null";
+		out += '}';
+	}
+	out += "]}";
+}
+
+using Isoline = std::vector<std::array<double, 2>>;
+
+// Isolines of one level in grid coordinates (col, row) by marching squares: a point on every cell
+// edge the level crosses, joined into polylines through the edges neighbouring cells share. Points
+// at or above the level are inside; a saddle cell is split by its centre, the mean of its corners.
+// Lines that close end on their first point.
+static std::vector<Isoline> traceIsolines(const std::vector<double>& values, size_t cols, size_t rows, double level) {
+	std::vector<Isoline> lines;
+	if (cols < 2 || rows < 2 || cols * rows != values.size()) return lines;
+
+	// Edge 2 * p runs from point p to its right, edge 2 * p + 1 from point p downwards
+	struct Crossing {
+		std::array<double, 2> at;
+		size_t segments[2];
+		size_t count {0};
+	};
+	std::unordered_map<size_t, Crossing> crossings;
+	std::vector<std::array<size_t, 2>> segments;
+	auto crossing = [&](size_t edge) -> Crossing& {
+		auto [it, fresh] = crossings.try_emplace(edge);
+		if (fresh) {
+			const size_t p = edge / 2, col = p % cols, row = p / cols;
+			const bool across = edge % 2 == 0;
+			const double a = values[p], b = values[across ? p + 1 : p + cols];
+			const double t = (level - a) / (b - a);
+			it->second.at = across ? std::array<double, 2> {col + t, static_cast<double>(row)}
+			                       : std::array<double, 2> {static_cast<double>(col), row + t};
+		}
+		return it->second;
+	};
+	auto addSegment = [&](size_t from, size_t to) {
+		for (size_t edge : {from, to}) {
+			Crossing& c = crossing(edge);
+			c.segments[c.count++] = segments.size();
+		}
+		segments.push_back({from, to});
+	};
+
+	for (size_t row = 0; row + 1 < rows; ++row) {
+		for (size_t col = 0; col + 1 < cols; ++col) {
+			const size_t p = row * cols + col;
+			// Corners clockwise from (row, col); edge k joins corner k to corner k + 1
+			const double v[4] = {values[p], values[p + 1], values[p + cols + 1], values[p + cols]};
+			const size_t edges[4] = {2 * p, 2 * (p + 1) + 1, 2 * (p + cols), 2 * p + 1};
+			if (!std::isfinite(v[0]) || !std::isfinite(v[1]) || !std::isfinite(v[2]) || !std::isfinite(v[3])) continue;
+			bool inside[4];
+			size_t crossed[4], count = 0;
+			for (int k = 0; k < 4; ++k) inside[k] = v[k] >= level;
+			for (int k = 0; k < 4; ++k) {
+				if (inside[k] != inside[(k + 1) % 4]) crossed[count++] = edges[k];
+			}
+			if (count == 2) {
+				addSegment(crossed[0], crossed[1]);
+			} else if (count == 4) {
+				// Cut off the two corners on the other side from the centre
+				const bool centre = (v[0] + v[1] + v[2] + v[3]) / 4.0 >= level;
+				for (int k = 0; k < 4; ++k) {
+					if (inside[k] != centre) addSegment(edges[(k + 3) % 4], edges[k]);
+				}
+			}
+		}
+	}
+
+	std::vector<bool> used(segments.size(), false);
+	auto follow = [&](size_t edge, size_t segment) {
+		Isoline line {crossings[edge].at};
+		while (true) {
+			used[segment] = true;
+			edge = segments[segment][0] == edge ? segments[segment][1] : segments[segment][0];
+			const Crossing& c = crossings[edge];
+			line.push_back(c.at);
+			if (c.count < 2) break;
+			segment = c.segments[0] == segment ? c.segments[1] : c.segments[0];
+			if (used[segment]) break;
+		}
+		lines.push_back(std::move(line));
+	};
+	// Open lines start where they leave the plane, then what remains are closed loops
+	for (size_t s = 0; s < segments.size(); ++s) {
+		if (used[s]) continue;
+		if (crossings[segments[s][0]].count == 1) follow(segments[s][0], s);
+		else if (crossings[segments[s][1]].count == 1) follow(segments[s][1], s);
+	}
+	for (size_t s = 0; s < segments.size(); ++s) {
+		if (!used[s]) follow(segments[s][0], s);
+	}
+	return lines;
+}
+
+// Appends ,"contours":[{"level":L,"lines":[[[u,v],...],...]},...] to a plane's JSON object. u and v
+// are distances along the plane's rows and columns from its first point.
+static void appendPlaneContoursJson(std::string& out, const std::string& planeName, const PlaneData& planeData,
+                                    const std::vector<double>& values, const OutputOptions& output) {
+	const GridFrame* frame = findGridFrame(output, planeName);
+	const double colSpacing = frame ? length(frame->alongCols) : 0.0;
+	const double rowSpacing = frame ? length(frame->alongRows) : 0.0;
+	out += ",\"contours\":[";
+	for (size_t l = 0; l < output.contourLevels.size(); ++l) {
+		const double level = output.contourLevels[l];
+		if (l > 0) out += ',';
+		out += "{\"level\":";
+		appendJsonNumber(out, level, output.precision);
+		out += ",\"lines\":[";
+		const std::vector<Isoline> lines =
+			frame ? traceIsolines(values, planeData.width, planeData.height, level) : std::vector<Isoline>();
+		for (size_t i = 0; i < lines.size(); ++i) {
+			if (i > 0) out += ',';
+			out += '[';
+			for (size_t j = 0; j < lines[i].size(); ++j) {
+				if (j > 0) out += ',';
+				out += '[';
+				appendJsonNumber(out, lines[i][j][0] * colSpacing, output.precision);
+				out += ',';
+				appendJsonNumber(out, lines[i][j][1] * rowSpacing, output.precision);
+				out += ']';
+			}
+			out += ']';
+		}
+		out += "]}";
+	}
+	out += ']';
+}
+
+// What a plane's JSON carries besides its name and size, as the request's output asks: values
+// (unless withValues is false, for binary frames that carry them raw), a summary, contours
+static void appendPlaneOutputJson(std::string& out, const std::string& planeName, const PlaneData& planeData,
+                                  const std::vector<double>& values, const OutputOptions& output, bool withValues) {
+	if (output.content == OutputOptions::Content::Values && withValues) {
+		out += ",\"values\":";
+		appendJsonNumbers(out, values, output.precision);
+	} else if (output.content == OutputOptions::Content::Summary) {
+		appendPlaneSummaryJson(out, planeName, planeData, values, output);
+	}
+	if (!output.contourLevels.empty()) appendPlaneContoursJson(out, planeName, planeData, values, output);
+}
+
+static void appendPlaneJson(std::string& out, const std::string& planeName, const PlaneData& planeData,
+                            const std::vector<double>& planeTemperatures, const OutputOptions& output) {
+	out += "{\"name\":\"";
+	out += jsonEscapeStringValue(planeName);
+	out += "\",\"width\":";
+	out += std::to_string(planeData.width);
+	out += ",\"height\":";
+	out += std::to_string(planeData.height);
+	appendPlaneOutputJson(out, planeName, planeData, planeTemperatures, output, true);
+	out += '}';
+}
+
+// viewFactorKey, when non-empty, names the traced run that /reweight can re-use
+static std::string formatCalculationJson(const PlaneResults& planes, const std::string& viewFactorKey,
+                                         const OutputOptions& output = OutputOptions()) {
+	size_t values = 0;
+	if (output.content == OutputOptions::Content::Values) {
+		for (const auto& plane : planes) values += plane.values.size();
+	}
+	std::string out;
+	out.reserve(128 + 64 * planes.size() + 12 * values);
+	out += "{\"success\":true,";
+	if (!viewFactorKey.empty()) {
+		out += "\"viewFactorKey\":\"" + viewFactorKey + "\",";
+	}
+	out += "\"planes\":[";
+	for (size_t k = 0; k < planes.size(); ++k) {
+		if (k > 0) out += ',';
+		appendPlaneJson(out, planes[k].name, planes[k].planeData, planes[k].values, output);
+	}
+	out += "]}";
+	return out;
+}
+
+// ===== Binary results =====
+//
+// Sent instead of JSON when Accept names application/vnd.tra.result.f32 (values as float32),
+// application/vnd.tra.result.f64 or application/vnd.tra.result.q16 (quantized, see below). A
+// response, streamed or not, is a 16-byte header and then one frame per event, all little-endian:
+//   header  uint32 magic "TRR1", version 1, bytes per value (4, 8, or 1: the block is bytes), 0
+//   frame   ResultFrameHeader; the event name, id and JSON, padded to 8 bytes; valueCount values,
+//           padded to 8 bytes
+// The events and their JSON are those of the SSE stream, except that a "plane" frame carries its
+// values as the value block. /calculate sends its planes as "plane" frames, then "complete". Every
+// frame is a multiple of 8 bytes long, so each value block can be used in place as a typed array.
+
+enum class ResultEncoding { Json, Float32, Float64, Quantized };
+
+static constexpr const char* kResultF32ContentType = "application/vnd.tra.result.f32";
+static constexpr const char* kResultF64ContentType = "application/vnd.tra.result.f64";
+static constexpr const char* kResultQ16ContentType = "application/vnd.tra.result.q16";
+static constexpr std::uint32_t kResultMagic = 0x31525254; // "TRR1"
+static constexpr std::uint32_t kResultVersion = 1;
+
+struct ResultFrameHeader {
+	std::uint32_t eventBytes;
+	std::uint32_t idBytes; // the event's id for Last-Event-ID, or 0
+	std::uint32_t jsonBytes;
+	std::uint32_t reserved;
+	std::uint64_t valueCount;
+};
+
+// Accept is a list of media ranges, each with an optional weight q (default 1). The encoding of
+// highest weight wins, the one listed first among equals. Binary types count only when named in full;
+// JSON also answers application/json, text/event-stream and wildcards, and is the fallback when no
+// binary type is acceptable. q=0 rules a type out.
+static ResultEncoding negotiateResultEncoding(const httplib::Request& req) {
+	if (!hostIsLittleEndian()) return ResultEncoding::Json;
+	const std::string accept = req.get_header_value("Accept");
+	auto trim = [](std::string_view v) {
+		while (!v.empty() && (v.front() == ' ' || v.front() == '\t')) v.remove_prefix(1);
+		while (!v.empty() && (v.back() == ' ' || v.back() == '\t')) v.remove_suffix(1);
+		return v;
+	};
+	auto equalsNoCase = [](std::string_view a, std::string_view b) {
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+			       return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+		       });
+	};
+	const std::pair<const char*, ResultEncoding> offered[] = {
+		{kResultF32ContentType, ResultEncoding::Float32}, {kResultF64ContentType, ResultEncoding::Float64},
+		{kResultQ16ContentType, ResultEncoding::Quantized}, {"application/json", ResultEncoding::Json},
+		{"text/event-stream", ResultEncoding::Json},        {"application/*", ResultEncoding::Json},
+		{"text/*", ResultEncoding::Json},                   {"*/*", ResultEncoding::Json}};
+
+	ResultEncoding chosen = ResultEncoding::Json;
+	double chosenQ = 0.0;
+	std::string_view rest = accept;
+	while (!rest.empty()) {
+		const size_t comma = rest.find(',');
+		std::string_view range = rest.substr(0, comma);
+		rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+
+		const size_t semicolon = range.find(';');
+		const std::string_view type = trim(range.substr(0, semicolon));
+		double q = 1.0;
+		for (std::string_view params = semicolon == std::string_view::npos ? std::string_view() : range.substr(semicolon + 1);
+		     !params.empty();) {
+			const size_t next = params.find(';');
+			const std::string_view param = trim(params.substr(0, next));
+			params = next == std::string_view::npos ? std::string_view() : params.substr(next + 1);
+			if (param.size() < 2 || (param[0] != 'q' && param[0] != 'Q') || param[1] != '=') continue;
+			const std::string_view weight = param.substr(2);
+			const std::from_chars_result r = std::from_chars(weight.data(), weight.data() + weight.size(), q);
+			if (r.ec != std::errc() || r.ptr != weight.data() + weight.size() || !(q >= 0.0 && q <= 1.0)) q = 0.0;
+		}
+		for (const auto& offer : offered) {
+			if (!equalsNoCase(type, offer.first)) continue;
+			// Strictly greater: among equal weights the earlier range keeps its place
+			if (q > chosenQ) {
+				chosenQ = q;
+				chosen = offer.second;
+			}
+			break;
+		}
+	}
+	return chosen;
+}
+
+static const char* resultContentType(ResultEncoding encoding) {
+	return encoding == ResultEncoding::Float32     ? kResultF32ContentType
+	       : encoding == ResultEncoding::Float64   ? kResultF64ContentType
+	       : encoding == ResultEncoding::Quantized ? kResultQ16ContentType
+	                                               : "application/json";
+}
+
+static std::string resultHeader(ResultEncoding encoding) {
+	const std::uint32_t valueBytes = encoding == ResultEncoding::Float32 ? 4u : encoding == ResultEncoding::Float64 ? 8u : 1u;
+	const std::uint32_t header[4] = {kResultMagic, kResultVersion, valueBytes, 0};
+	return std::string(reinterpret_cast<const char*>(header), sizeof(header));
+}
+
+// A frame whose value block, if any, has been written to `block` already
+static void appendResultFrame(std::string& out, const char* event, const std::string& id, const std::string& json,
+                              const char* block = nullptr, size_t blockBytes = 0, size_t valueCount = 0) {
+	ResultFrameHeader h {};
+	h.eventBytes = static_cast<std::uint32_t>(std::strlen(event));
+	h.idBytes = static_cast<std::uint32_t>(id.size());
+	h.jsonBytes = static_cast<std::uint32_t>(json.size());
+	h.valueCount = valueCount;
+	auto pad = [&out]() { out.resize((out.size() + 7) & ~static_cast<size_t>(7), '\0'); };
+	out.append(reinterpret_cast<const char*>(&h), sizeof(h));
+	out.append(event, h.eventBytes);
+	out += id;
+	out += json;
+	pad();
+	out.append(block, blockBytes);
+	pad();
+}
+
+// ===== Quantized results =====
+//
+// application/vnd.tra.result.q16 codes each plane instead of sending it raw. Values are quantized to
+// 16 bits over the plane's range, or more coarsely when the request allows a larger "max_error". Each
+// level is predicted from its left neighbour (the first of a row from the one above), and the
+// zigzagged residuals are Golomb-Rice coded, MSB first, with the parameter adapted to their running
+// mean as in LOCO-I. A "plane" frame's JSON adds "min", "step" and "maxError" (the largest error
+// actually made); level k decodes to min + k * step. The value block is the coded bytes.
+
+static constexpr std::uint32_t kQuantizedLevels = 65535; // top level of 16 bits
+static constexpr unsigned kRiceEscape = 24;              // a unary prefix this long is followed by the raw residual
+static constexpr unsigned kRiceRawBits = 17;             // a zigzagged difference of two 16-bit levels
+static constexpr std::uint32_t kRiceInitialSum = 256;
+static constexpr std::uint32_t kRiceResetCount = 64;     // the running mean halves its history this often
+
+struct QuantizedPlane {
+	double min {0.0};
+	double step {0.0};
+	double maxError {0.0};
+	std::string coded;
+};
+
+class BitWriter {
+public:
+	explicit BitWriter(std::string& out) : out_(out) {}
+	// Low `count` (at most 24) bits of `bits`
+	void put(std::uint32_t bits, unsigned count) {
+		acc_ = (acc_ << count) | (bits & ((std::uint64_t {1} << count) - 1));
+		pending_ += count;
+		while (pending_ >= 8) {
+			pending_ -= 8;
+			out_ += static_cast<char>((acc_ >> pending_) & 0xff);
+		}
+		acc_ &= (std::uint64_t {1} << pending_) - 1;
+	}
+	void ones(unsigned count) {
+		for (; count > 16; count -= 16) put(0xffff, 16);
+		put((1u << count) - 1, count);
+	}
+	void flush() {
+		if (pending_ > 0) put(0, 8 - pending_);
+	}
+
+private:
+	std::string& out_;
+	std::uint64_t acc_ {0};
+	unsigned pending_ {0};
+};
+
+// maxError > 0 lets the step grow to 2 * maxError when that is coarser than 16 bits over the range
+static QuantizedPlane quantizePlane(const std::vector<double>& values, size_t width, double maxError) {
+	QuantizedPlane q;
+	double lo = std::numeric_limits<double>::infinity(), hi = -lo;
+	for (double v : values) {
+		if (!std::isfinite(v)) continue;
+		lo = std::min(lo, v);
+		hi = std::max(hi, v);
+	}
+	if (lo > hi) lo = hi = 0.0;
+	q.min = lo;
+	q.step = std::max((hi - lo) / kQuantizedLevels, 2.0 * maxError);
+	if (!std::isfinite(q.step)) q.step = 0.0;
+	if (width == 0 || values.size() % width != 0) width = values.size();
+
+	std::vector<std::uint32_t> levels(values.size());
+	for (size_t i = 0; i < values.size(); ++i) {
+		const double scaled = q.step > 0.0 && std::isfinite(values[i]) ? (values[i] - q.min) / q.step : 0.0;
+		levels[i] = static_cast<std::uint32_t>(std::min<double>(std::max(std::round(scaled), 0.0), kQuantizedLevels));
+		// Non-finite values decode to min; they have no error to report
+		if (std::isfinite(values[i])) q.maxError = std::max(q.maxError, std::abs(values[i] - (q.min + levels[i] * q.step)));
+	}
+
+	BitWriter bits(q.coded);
+	std::uint32_t sum = kRiceInitialSum, count = 1;
+	for (size_t i = 0; i < levels.size(); ++i) {
+		const size_t x = i % width;
+		const std::uint32_t predicted = x > 0 ? levels[i - 1] : i >= width ? levels[i - width] : 0;
+		const std::int32_t residual = static_cast<std::int32_t>(levels[i]) - static_cast<std::int32_t>(predicted);
+		const std::uint32_t zigzag = residual >= 0 ? static_cast<std::uint32_t>(residual) << 1
+		                                           : (static_cast<std::uint32_t>(-residual) << 1) - 1;
+		unsigned k = 0;
+		while ((count << k) < sum && k < 16) ++k;
+		if ((zigzag >> k) < kRiceEscape) {
+			bits.ones(zigzag >> k);
+			bits.put(0, 1);
+			bits.put(zigzag, k);
+		} else {
+			bits.ones(kRiceEscape);
+			bits.put(zigzag, kRiceRawBits);
+		}
+		sum += zigzag;
+		if (++count == kRiceResetCount) {
+			sum >>= 1;
+			count >>= 1;
+		}
+	}
+	bits.flush();
+	return q;
+}
+
+// Inverse of quantizePlane, as the frontend's decodeQuantizedPlane reads a q16 value block; bitsRead
+// reports how much of coded it used. Only the --bench-format self-check decodes on this side.
+static std::vector<double> decodeQuantizedPlane(const std::string& coded, size_t count, size_t width, double min, double step,
+                                                size_t& bitsRead) {
+	if (width == 0 || count % width != 0) width = count;
+	std::vector<std::uint32_t> levels(count);
+	std::vector<double> values(count);
+	bitsRead = 0;
+	auto readBit = [&]() -> std::uint32_t {
+		const size_t byte = bitsRead >> 3;
+		const std::uint32_t b = byte < coded.size() ? (static_cast<unsigned char>(coded[byte]) >> (7 - (bitsRead & 7))) & 1u : 0u;
+		++bitsRead;
+		return b;
+	};
+	auto readBits = [&](unsigned n) {
+		std::uint32_t v = 0;
+		for (unsigned b = 0; b < n; ++b) v = (v << 1) | readBit();
+		return v;
+	};
+	std::uint32_t sum = kRiceInitialSum, count1 = 1;
+	for (size_t i = 0; i < count; ++i) {
+		unsigned k = 0;
+		while ((count1 << k) < sum && k < 16) ++k;
+		unsigned prefix = 0;
+		while (prefix < kRiceEscape && readBit()) ++prefix;
+		const std::uint32_t zigzag = prefix < kRiceEscape ? (prefix << k) | readBits(k) : readBits(kRiceRawBits);
+		const std::int64_t residual = (zigzag & 1) ? -static_cast<std::int64_t>((zigzag + 1) >> 1) : static_cast<std::int64_t>(zigzag >> 1);
+		const size_t x = i % width;
+		const std::uint32_t predicted = x > 0 ? levels[i - 1] : i >= width ? levels[i - width] : 0;
+		levels[i] = static_cast<std::uint32_t>(predicted + residual);
+		values[i] = min + levels[i] * step;
+		sum += zigzag;
+		if (++count1 == kRiceResetCount) {
+			sum >>= 1;
+			count1 >>= 1;
+		}
+	}
+	return values;
+}
+
+// A "plane" (or "tile") frame: `json` is the plane's JSON without values
+static void appendPlaneFrame(std::string& out, ResultEncoding encoding, const char* name, const std::string& id, std::string json,
+                             const std::vector<double>& values, size_t width, const ValuePrecision& precision) {
+	if (encoding == ResultEncoding::Float64) {
+		appendResultFrame(out, name, id, json, reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double),
+		                  values.size());
+	} else if (encoding == ResultEncoding::Float32) {
+		std::vector<float> narrowed(values.begin(), values.end());
+		appendResultFrame(out, name, id, json, reinterpret_cast<const char*>(narrowed.data()), narrowed.size() * sizeof(float),
+		                  narrowed.size());
+	} else {
+		const QuantizedPlane q = quantizePlane(values, width, precision.maxError);
+		ValuePrecision exact;
+		exact.mode = ValuePrecision::Mode::Shortest;
+		json.pop_back();
+		json += ",\"min\":";
+		appendJsonNumber(json, q.min, exact);
+		json += ",\"step\":";
+		appendJsonNumber(json, q.step, exact);
+		json += ",\"maxError\":";
+		appendJsonNumber(json, q.maxError, exact);
+		json += '}';
+		appendResultFrame(out, name, id, json, q.coded.data(), q.coded.size(), q.coded.size());
+	}
+}
+
+static std::string formatCompleteEventJson(const std::string& viewFactorKey) {
+	return viewFactorKey.empty() ? std::string("{\"success\":true}")
+	                             : "{\"success\":true,\"viewFactorKey\":\"" + viewFactorKey + "\"}";
+}
+
+// A /calculate (or /reweight) response body in the negotiated encoding
+static std::string formatCalculationResult(const PlaneResults& planes, const std::string& viewFactorKey, ResultEncoding encoding,
+                                           const OutputOptions& output = OutputOptions()) {
+	if (encoding == ResultEncoding::Json) return formatCalculationJson(planes, viewFactorKey, output);
+	std::string out = resultHeader(encoding);
+	for (const auto& plane : planes) {
+		std::string json = "{\"name\":\"" + jsonEscapeStringValue(plane.name) + "\",\"width\":" +
+		                   std::to_string(plane.planeData.width) + ",\"height\":" + std::to_string(plane.planeData.height);
+		appendPlaneOutputJson(json, plane.name, plane.planeData, plane.values, output, false);
+		json += '}';
+		if (output.content == OutputOptions::Content::Values) {
+			appendPlaneFrame(out, encoding, "plane", "", json, plane.values, plane.planeData.width, output.precision);
+		} else {
+			appendResultFrame(out, "plane", "", json);
+		}
+	}
+	appendResultFrame(out, "complete", "", formatCompleteEventJson(viewFactorKey));
+	return out;
+}
+
+// Worker side of coordinator mode: trace one shard and return its values at full precision
+static std::string runShard(const std::string& jsonInput, CancelToken* cancel, bool& ok) {
+	JsonInput in;
+	std::string err;
+	if (!parseInputJson(jsonInput, in, err, parseThreadCount())) {
+		ok = false;
+		return std::string("{\"error\": \"") + jsonEscapeStringValue(err) + "\"}";
+	}
+	if (!in.seed.has_value()) {
+		ok = false;
+		return "{\"error\": \"shard requests must carry a seed\"}";
+	}
+
+	std::mt19937_64 rng(in.seed.value());
+	// Shortest round-trip text: the coordinator reads back exactly these doubles
+	ValuePrecision exact;
+	exact.mode = ValuePrecision::Mode::Shortest;
+	std::string out = "{\"success\":true,\"values\":[";
+	bool first = true;
+	const bool finished = runReceiverPlanes(in, rng, cancel, [&](const std::string&, const PlaneData&,
+	                                                                 const std::vector<double>& planeTemperatures, size_t, size_t) {
+		for (double v : planeTemperatures) {
+			if (!first) out += ',';
+			first = false;
+			appendJsonNumber(out, v, exact);
+		}
+		return true;
+	});
+	if (!finished) {
+		ok = false;
+		return std::string("{\"error\": \"shard cancelled: ") + (cancel ? cancel->why() : "interrupted") + "\"}";
+	}
+	out += "]}";
+	ok = true;
+	return out;
+}
+
+// POST /reweight: {"view_factor_key": "...", "temperatures": [one per emitter, in request order]}
+static std::string runReweight(const std::string& jsonInput, bool& ok, ResultEncoding encoding = ResultEncoding::Json) {
+	using namespace mini_json;
+	ok = false;
+	std::string key;
+	std::vector<double> temperatures;
+	bool haveKey = false, haveTemperatures = false;
+	const char* invalid = nullptr;
+	Reader r(jsonInput);
+	const bool parsed = r.object([&](std::string_view member) {
+		if (member == "view_factor_key") {
+			std::string_view value;
+			if (!r.string(value)) { invalid = "Invalid view_factor_key"; return false; }
+			key = std::string(value);
+			haveKey = true;
+		} else if (member == "temperatures") {
+			temperatures.clear();
+			if (!r.array([&]() { return r.number(temperatures.emplace_back()); })) { invalid = "Invalid temperatures"; return false; }
+			haveTemperatures = true;
+		} else {
+			return r.skipValue();
+		}
+		return true;
+	});
+	if (invalid) return std::string("{\"error\": \"") + invalid + "\"}";
+	if (!parsed) return "{\"error\": \"Malformed JSON near offset " + std::to_string(r.offset()) + "\"}";
+	if (!haveKey || !haveTemperatures) return "{\"error\": \"Must provide 'view_factor_key' and 'temperatures'\"}";
+
+	const std::shared_ptr<const TracedRun> run = findTracedRun(key);
+	if (!run) return "{\"error\": \"unknown view_factor_key\"}";
+	if (temperatures.size() != run->viewFactors.numEmitters) {
+		return "{\"error\": \"expected " + std::to_string(run->viewFactors.numEmitters) + " temperatures\"}";
+	}
+
+	PlaneResults planes = reweightTracedRun(*run, temperatures);
+	std::string body = formatCalculationResult(planes, key, encoding);
+
+	// The re-weighted grids are exactly what a full trace with these temperatures returns
+	if (isReusableRequest(run->input)) {
+		g_resultCache.insert(hashCalculationInput(run->input, true, temperatures.data()), std::move(planes));
+	}
+	ok = true;
+	return body;
+}
+
+// Bounded single-producer/single-consumer ring buffer. The ring itself is lock-free: one slot is kept
+// empty to tell full from empty, and head and tail sit on separate cache lines so producer and
+// consumer don't contend. A side with nothing to do sleeps in waitUntil, so each push and pop also
+// briefly takes a mutex to wake the other side; events are whole planes or tiles, so that is cheap.
+template <typename T>
+class SpscQueue {
+public:
+	explicit SpscQueue(size_t capacity) : slots_(capacity + 1) {}
+
+	// Moves from item only on success; returns false when full
+	bool tryPush(T& item) {
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+		const size_t next = (tail + 1) % slots_.size();
+		if (next == head_.load(std::memory_order_acquire)) return false;
+		slots_[tail] = std::move(item);
+		tail_.store(next, std::memory_order_release);
+		notify();
+		return true;
+	}
+	bool tryPop(T& out) {
+		const size_t head = head_.load(std::memory_order_relaxed);
+		if (head == tail_.load(std::memory_order_acquire)) return false;
+		out = std::move(slots_[head]);
+		head_.store((head + 1) % slots_.size(), std::memory_order_release);
+		notify();
+		return true;
+	}
+	bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+	bool full() const {
+		return (tail_.load(std::memory_order_acquire) + 1) % slots_.size() == head_.load(std::memory_order_acquire);
+	}
+
+	// Blocks until ready() holds, a push, pop or notify() makes it hold, or deadline passes
+	template <typename Ready>
+	void waitUntil(std::chrono::steady_clock::time_point deadline, Ready ready) {
+		std::unique_lock<std::mutex> lock(wakeMutex_);
+		wakeup_.wait_until(lock, deadline, ready);
+	}
+	// For state outside the queue that a waiter's ready() reads, e.g. a done flag
+	void notify() {
+		// Taking the mutex orders the change before a waiter's check of ready(), so no wakeup is lost
+		{ std::lock_guard<std::mutex> lock(wakeMutex_); }
+		wakeup_.notify_all();
+	}
+
+private:
+	std::vector<T> slots_;
+	alignas(64) std::atomic<size_t> head_ {0};
+	alignas(64) std::atomic<size_t> tail_ {0};
+	std::mutex wakeMutex_;
+	std::condition_variable wakeup_;
+};
+
+// Raw result handed from the compute thread to the SSE writer; formatting happens on the writer side
+struct StreamEvent {
+	enum class Kind { Plane, Progress, Round, Tile };
+	Kind kind {Kind::Plane};
+	std::string planeName;
+	PlaneData planeData {};
+	std::vector<double> values; // a tile's own values only
+	size_t offset {0};          // tile: index of its first point in the plane
+	size_t planeIndex1Based {0};
+	size_t totalPlanes {0};
+	ProgressInfo progress {};
+	bool refined {false}; // progressive mode: plane and round events carry refinement
+	RefinementStatus refinement {};
+};
+
+// Planes in flight between compute and the socket; beyond this compute waits (bounded backpressure)
+static constexpr size_t kStreamQueueCapacity = 4;
+// How often an idle stream checks that its client is still there and its job not cancelled
+static constexpr std::chrono::milliseconds kStreamLivenessInterval {100};
+
+// Tile of points [offset, offset + count) of a plane event
+static StreamEvent makeTileEvent(const StreamEvent& plane, size_t offset, size_t count) {
+	StreamEvent tile;
+	tile.kind = StreamEvent::Kind::Tile;
+	tile.planeName = plane.planeName;
+	tile.planeData = plane.planeData;
+	tile.offset = offset;
+	tile.values.assign(plane.values.begin() + static_cast<std::ptrdiff_t>(offset),
+	                   plane.values.begin() + static_cast<std::ptrdiff_t>(offset + count));
+	tile.planeIndex1Based = plane.planeIndex1Based;
+	tile.totalPlanes = plane.totalPlanes;
+	return tile;
+}
+
+// A tile event's JSON; row and rows place it in the plane's grid
+static void appendTileEventJson(std::string& out, const StreamEvent& ev, const ValuePrecision& precision, bool withValues) {
+	const size_t cols = std::max<size_t>(planeTileColumns(ev.planeData), 1);
+	out += "{\"name\":\"";
+	out += jsonEscapeStringValue(ev.planeName);
+	out += "\",\"width\":";
+	out += std::to_string(ev.planeData.width);
+	out += ",\"height\":";
+	out += std::to_string(ev.planeData.height);
+	out += ",\"planeIndex\":";
+	out += std::to_string(ev.planeIndex1Based);
+	out += ",\"totalPlanes\":";
+	out += std::to_string(ev.totalPlanes);
+	out += ",\"offset\":";
+	out += std::to_string(ev.offset);
+	out += ",\"row\":";
+	out += std::to_string(ev.offset / cols);
+	out += ",\"rows\":";
+	out += std::to_string((ev.values.size() + cols - 1) / cols);
+	if (withValues) {
+		out += ",\"values\":";
+		appendJsonNumbers(out, ev.values, precision);
+	}
+	out += '}';
+}
+
+// A plane event's JSON; withValues false leaves out "values" (binary frames carry them raw)
+static void appendPlaneEventJson(std::string& out, const StreamEvent& ev, const OutputOptions& output, bool withValues) {
+	out += "{\"name\":\"";
+	out += jsonEscapeStringValue(ev.planeName);
+	out += "\",\"width\":";
+	out += std::to_string(ev.planeData.width);
+	out += ",\"height\":";
+	out += std::to_string(ev.planeData.height);
+	out += ",\"planeIndex\":";
+	out += std::to_string(ev.planeIndex1Based);
+	out += ",\"totalPlanes\":";
+	out += std::to_string(ev.totalPlanes);
+	if (ev.refined) {
+		out += ",\"round\":";
+		out += std::to_string(ev.refinement.round);
+		out += ",\"raysPerPoint\":";
+		out += std::to_string(ev.refinement.raysPerPoint);
+		out += ",\"maxStdErr\":";
+		appendJsonNumber(out, ev.refinement.maxStdErr, ValuePrecision());
+	}
+	appendPlaneOutputJson(out, ev.planeName, ev.planeData, ev.values, output, withValues);
+	out += '}';
+}
+
+// Doubles go through appendJsonNumber at its default 6 significant digits, like a plane event's maxStdErr
+static std::string formatRoundEventJson(const RefinementStatus& r) {
+	std::string out = "{\"round\":" + std::to_string(r.round);
+	out += ",\"raysPerPoint\":" + std::to_string(r.raysPerPoint);
+	out += ",\"maxStdErr\":";
+	appendJsonNumber(out, r.maxStdErr, ValuePrecision());
+	out += ",\"elapsedSeconds\":";
+	appendJsonNumber(out, r.elapsedSeconds, ValuePrecision());
+	out += '}';
+	return out;
+}
+
+static std::string formatProgressEventJson(const ProgressInfo& p) {
+	std::string out = "{\"pointsDone\":" + std::to_string(p.pointsDone);
+	out += ",\"totalPoints\":" + std::to_string(p.totalPoints);
+	out += ",\"raysTraced\":" + std::to_string(p.raysTraced);
+	out += ",\"raysPerSecond\":" + std::to_string(std::llround(p.raysPerSecond));
+	out += ",\"elapsedSeconds\":";
+	appendJsonNumber(out, p.elapsedSeconds, ValuePrecision());
+	out += ",\"etaSeconds\":";
+	if (p.etaSeconds >= 0.0) appendJsonNumber(out, p.etaSeconds, ValuePrecision()); else out += "null";
+	out += ",\"planeIndex\":" + std::to_string(p.planeIndex1Based);
+	out += ",\"totalPlanes\":" + std::to_string(p.totalPlanes) + "}";
+	return out;
+}
+
+static bool sendsTiles(const OutputOptions& output) {
+	return output.tileRows > 0 && output.content == OutputOptions::Content::Values;
+}
+
+// Appends one stream event to `out` as an SSE message or a binary result frame. The data is
+// `payload` formatted, or `data` when there is no payload; id is sent for Last-Event-ID unless empty.
+// With tiles, a plane event is preceded by the tiles of its rows from rowsSent on and sent without values.
+static void appendStreamEvent(std::string& out, ResultEncoding encoding, const OutputOptions& output, const char* name,
+                              const std::string& id, const StreamEvent* payload, const std::string& data = std::string(),
+                              size_t rowsSent = 0) {
+	const bool plane = payload && payload->kind == StreamEvent::Kind::Plane;
+	const bool tile = payload && payload->kind == StreamEvent::Kind::Tile;
+	if (plane && sendsTiles(output)) {
+		const size_t cols = std::max<size_t>(planeTileColumns(payload->planeData), 1);
+		const size_t tilePoints = cols * output.tileRows;
+		for (size_t offset = rowsSent * cols; offset < payload->values.size(); offset += tilePoints) {
+			const StreamEvent t = makeTileEvent(*payload, offset, std::min(tilePoints, payload->values.size() - offset));
+			appendStreamEvent(out, encoding, output, "tile", "", &t);
+		}
+	}
+	if (encoding == ResultEncoding::Json) {
+		if (!id.empty()) out += "id: " + id + "\n";
+		out += "event: ";
+		out += name;
+		out += "\ndata: ";
+		if (!payload) out += data;
+		else if (plane) appendPlaneEventJson(out, *payload, output, !sendsTiles(output));
+		else if (tile) appendTileEventJson(out, *payload, output.precision, true);
+		else if (payload->kind == StreamEvent::Kind::Round) out += formatRoundEventJson(payload->refinement);
+		else out += formatProgressEventJson(payload->progress);
+		out += "\n\n";
+		return;
+	}
+	if (tile) {
+		std::string json;
+		appendTileEventJson(json, *payload, output.precision, false);
+		appendPlaneFrame(out, encoding, name, id, std::move(json), payload->values, planeTileColumns(payload->planeData),
+		                 output.precision);
+		return;
+	}
+	if (plane) {
+		std::string json;
+		appendPlaneEventJson(json, *payload, output, false);
+		if (output.content == OutputOptions::Content::Values && !sendsTiles(output)) {
+			appendPlaneFrame(out, encoding, name, id, std::move(json), payload->values, payload->planeData.width, output.precision);
+		} else {
+			appendResultFrame(out, name, id, json);
+		}
+		return;
+	}
+	const std::string json = !payload ? data
+	                         : payload->kind == StreamEvent::Kind::Round ? formatRoundEventJson(payload->refinement)
+	                                                                     : formatProgressEventJson(payload->progress);
+	appendResultFrame(out, name, id, json);
+}
+
+// Content type of a /calculate/stream response
+static const char* streamContentType(ResultEncoding encoding) {
+	return encoding == ResultEncoding::Json ? "text/event-stream" : resultContentType(encoding);
+}
+
+// A running calculation that can be cancelled by id (POST /jobs/:id/cancel) or on shutdown
+struct Job {
+	std::string id;
+	CancelToken cancel;
+};
+
+class JobRegistry {
+public:
+	// Registers a new job; uses the client-supplied id when given and not already in use
+	std::shared_ptr<Job> start(const std::string& requestedId) {
+		auto job = std::make_shared<Job>();
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!requestedId.empty() && requestedId.size() <= 64 && jobs_.find(requestedId) == jobs_.end()) {
+			job->id = requestedId;
+		} else {
+			std::ostringstream id;
+			id << "job-" << std::hex << rng_() << std::dec << "-" << ++counter_;
+			job->id = id.str();
+		}
+		jobs_[job->id] = job;
+		return job;
+	}
+	void finish(const std::string& id) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		jobs_.erase(id);
+	}
+	bool cancel(const std::string& id, const char* why) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = jobs_.find(id);
+		if (it == jobs_.end()) return false;
+		it->second->cancel.cancel(why);
+		return true;
+	}
+	void cancelAll(const char* why) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto& kv : jobs_) kv.second->cancel.cancel(why);
+	}
+	size_t size() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return jobs_.size();
+	}
+
+private:
+	std::mutex mutex_;
+	std::map<std::string, std::shared_ptr<Job>> jobs_;
+	std::mt19937_64 rng_ {std::random_device{}()};
+	std::uint64_t counter_ {0};
+};
+
+static JobRegistry g_jobs;
+
+// Removes a job from the registry when the request that owns it ends
+struct JobScope {
+	std::shared_ptr<Job> job;
+	explicit JobScope(std::shared_ptr<Job> j) : job(std::move(j)) {}
+	~JobScope() { g_jobs.finish(job->id); }
+	JobScope(const JobScope&) = delete;
+	JobScope& operator=(const JobScope&) = delete;
+};
+
+// ===== Flights: one computation's event log, shared by identical requests and kept for resuming =====
+
+// One entry of a flight's event log. Plane and progress events keep their raw values and are
+// formatted, per encoding and output options, the first time a streaming subscriber needs them, then
+// shared by all subscribers wanting the same.
+struct FlightEvent {
+	const char* name {"plane"};
+	StreamEvent payload;
+	std::string data; // set for events stored already formatted
+	std::string id;   // "<flight id>:<log index>", sent as the SSE id for Last-Event-ID
+
+	const std::string& message(ResultEncoding encoding, const OutputOptions& output) {
+		// Only what this encoding and content use is kept, so requests differing elsewhere share the text.
+		// JSON depends only on the digits, quantized frames only on max_error, raw frames on neither;
+		// in any encoding, summaries and contours depend on the digits too
+		OutputOptions used;
+		used.content = output.content;
+		const bool values = used.content == OutputOptions::Content::Values;
+		if (used.content == OutputOptions::Content::Summary) used.thresholds = output.thresholds;
+		used.contourLevels = output.contourLevels;
+		used.frames = output.frames;
+		if (values) used.tileRows = output.tileRows;
+		if (encoding == ResultEncoding::Json || used.derived()) {
+			used.precision.mode = output.precision.mode;
+			if (output.precision.mode != ValuePrecision::Mode::Shortest) used.precision.digits = output.precision.digits;
+		}
+		if (encoding == ResultEncoding::Quantized && values) used.precision.maxError = output.precision.maxError;
+		std::lock_guard<std::mutex> lock(formatMutex_);
+		for (const auto& m : messages_) {
+			if (m.encoding == encoding && m.output == used) return m.text;
+		}
+		messages_.push_back({encoding, used, std::string()});
+		appendStreamEvent(messages_.back().text, encoding, used, name, id, data.empty() ? &payload : nullptr, data);
+		return messages_.back().text;
+	}
+
+private:
+	struct Formatted {
+		ResultEncoding encoding;
+		OutputOptions output;
+		std::string text;
+	};
+	std::mutex formatMutex_;
+	std::deque<Formatted> messages_; // a deque keeps handed-out references valid as it grows
+};
+
+static std::shared_ptr<FlightEvent> makeFlightEvent(StreamEvent ev) {
+	auto e = std::make_shared<FlightEvent>();
+	e->name = ev.kind == StreamEvent::Kind::Plane ? "plane" : "progress";
+	e->payload = std::move(ev);
+	return e;
+}
+
+// The first request (the leader) computes and appends every event plus a final "complete" or
+// "error" to the log; followers replay it from some index (0, or just past a Last-Event-ID) and
+// then tail it. A leader whose client vanished keeps computing while anyone follows, and for the
+// resume window after that.
+class Flight {
+public:
+	Flight(std::string id, std::string requestKey) : id_(std::move(id)), requestKey_(std::move(requestKey)) {}
+	const std::string& id() const { return id_; }
+	const std::string& requestKey() const { return requestKey_; }
+
+	void append(std::shared_ptr<FlightEvent> e) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		e->id = id_ + ":" + std::to_string(log_.size());
+		log_.push_back(std::move(e));
+		changed_.notify_all();
+	}
+	// Both return the terminal ("complete" / "error") event they logged
+	std::shared_ptr<FlightEvent> succeed(std::shared_ptr<const PlaneResults> planes, const std::string& viewFactorKey) {
+		auto e = std::make_shared<FlightEvent>();
+		e->name = "complete";
+		e->data = formatCompleteEventJson(viewFactorKey);
+		std::lock_guard<std::mutex> lock(mutex_);
+		planes_ = std::move(planes);
+		viewFactorKey_ = viewFactorKey;
+		finishLocked(e);
+		return e;
+	}
+	std::shared_ptr<FlightEvent> fail(const std::string& message) {
+		auto e = std::make_shared<FlightEvent>();
+		e->name = "error";
+		e->data = "{\"message\":\"" + jsonEscapeStringValue(message) + "\"}";
+		std::lock_guard<std::mutex> lock(mutex_);
+		error_ = message;
+		finishLocked(e);
+		return e;
+	}
+	bool done() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return done_;
+	}
+	// True once finished for longer than `window`
+	bool expired(std::chrono::steady_clock::time_point now, std::chrono::seconds window) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return done_ && now - finishedAt_ >= window;
+	}
+	// Entry `index` once it exists, waiting up to `timeout`; null with ended = true past the last one
+	std::shared_ptr<FlightEvent> waitEvent(size_t index, std::chrono::milliseconds timeout, bool& ended) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		changed_.wait_for(lock, timeout, [&]() { return index < log_.size() || done_; });
+		ended = index >= log_.size() && done_;
+		return index < log_.size() ? log_[index] : nullptr;
+	}
+	bool waitDone(std::chrono::milliseconds timeout) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		return changed_.wait_for(lock, timeout, [&]() { return done_; });
+	}
+	// Same body /calculate would have returned; only valid once done
+	std::string result(bool& ok, std::string& viewFactorKey, ResultEncoding encoding = ResultEncoding::Json,
+	                   const OutputOptions& output = OutputOptions()) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		ok = planes_ != nullptr;
+		viewFactorKey = viewFactorKey_;
+		return ok ? formatCalculationResult(*planes_, viewFactorKey_, encoding, output)
+		          : "{\"error\": \"" + jsonEscapeStringValue(error_) + "\"}";
+	}
+	std::string viewFactorKey() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return viewFactorKey_;
+	}
+	void addFollower() { ++followers_; }
+	void removeFollower() { --followers_; }
+	bool hasFollowers() const { return followers_.load() > 0; }
+
+private:
+	void finishLocked(std::shared_ptr<FlightEvent> terminal) {
+		terminal->id = id_ + ":" + std::to_string(log_.size());
+		log_.push_back(std::move(terminal));
+		done_ = true;
+		finishedAt_ = std::chrono::steady_clock::now();
+		changed_.notify_all();
+	}
+
+	const std::string id_;
+	const std::string requestKey_; // canonical hash of the request, checked before resuming
+	std::mutex mutex_;
+	std::condition_variable changed_;
+	std::vector<std::shared_ptr<FlightEvent>> log_;
+	bool done_ {false};
+	std::chrono::steady_clock::time_point finishedAt_;
+	std::shared_ptr<const PlaneResults> planes_; // null unless the flight succeeded
+	std::string viewFactorKey_;
+	std::string error_;
+	std::atomic<size_t> followers_ {0};
+};
+
+static constexpr size_t kMaxRetainedFlights = 32;
+
+class FlightRegistry {
+public:
+	void setResumeWindow(std::chrono::seconds window) { window_ = window; }
+	std::chrono::seconds resumeWindow() const { return window_; }
+
+	// The flight running under coalesceKey, or a new one the caller leads (leader = true). An empty
+	// coalesceKey (request not reusable) always starts a new flight.
+	std::shared_ptr<Flight> join(const std::string& coalesceKey, const std::string& requestKey, bool& leader) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = coalesceKey.empty() ? running_.end() : running_.find(coalesceKey);
+		if (it != running_.end()) {
+			leader = false;
+			it->second->addFollower();
+			++coalesced_;
+			return it->second;
+		}
+		leader = true;
+		std::ostringstream id;
+		id << "fl-" << std::hex << rng_() << std::dec << "-" << ++counter_;
+		auto flight = std::make_shared<Flight>(id.str(), requestKey);
+		if (!coalesceKey.empty()) running_[coalesceKey] = flight;
+		if (window_.count() > 0) {
+			pruneLocked();
+			retained_.push_back(flight);
+		}
+		return flight;
+	}
+	// A flight still running or finished within the resume window, for a reconnect of the same request
+	std::shared_ptr<Flight> resume(const std::string& flightId, const std::string& requestKey) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		pruneLocked();
+		for (const auto& flight : retained_) {
+			if (flight->id() != flightId || flight->requestKey() != requestKey) continue;
+			flight->addFollower();
+			++resumed_;
+			return flight;
+		}
+		return nullptr;
+	}
+	void land(const std::string& coalesceKey) {
+		if (coalesceKey.empty()) return;
+		std::lock_guard<std::mutex> lock(mutex_);
+		running_.erase(coalesceKey);
+	}
+	std::string metricsJson() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		pruneLocked();
+		return "{\"inFlight\": " + std::to_string(running_.size()) + ", \"retained\": " + std::to_string(retained_.size()) +
+		       ", \"coalesced\": " + std::to_string(coalesced_) + ", \"resumed\": " + std::to_string(resumed_) + "}";
+	}
+
+private:
+	// Finished flights leave after the window, oldest first beyond kMaxRetainedFlights
+	void pruneLocked() {
+		const auto now = std::chrono::steady_clock::now();
+		retained_.erase(std::remove_if(retained_.begin(), retained_.end(),
+		                               [&](const std::shared_ptr<Flight>& f) { return f->expired(now, window_); }),
+		                retained_.end());
+		for (auto it = retained_.begin(); retained_.size() > kMaxRetainedFlights && it != retained_.end();) {
+			it = (*it)->done() ? retained_.erase(it) : std::next(it);
+		}
+	}
+
+	std::mutex mutex_;
+	std::map<std::string, std::shared_ptr<Flight>> running_; // by coalesce key
+	std::deque<std::shared_ptr<Flight>> retained_;            // in start order
+	std::chrono::seconds window_ {60};
+	std::mt19937_64 rng_ {std::random_device{}()};
+	std::uint64_t counter_ {0};
+	std::uint64_t coalesced_ {0};
+	std::uint64_t resumed_ {0};
+};
+
+static FlightRegistry g_flights;
+
+// Held by the request computing a flight; a flight it never finished fails rather than hangs
+struct FlightLeader {
+	std::shared_ptr<Flight> flight;
+	std::string key;
+	FlightLeader(std::shared_ptr<Flight> f, std::string k) : flight(std::move(f)), key(std::move(k)) {}
+	~FlightLeader() {
+		if (!flight->done()) flight->fail("calculation interrupted");
+		g_flights.land(key);
+	}
+	FlightLeader(const FlightLeader&) = delete;
+	FlightLeader& operator=(const FlightLeader&) = delete;
+};
+
+struct FlightFollower {
+	std::shared_ptr<Flight> flight;
+	explicit FlightFollower(std::shared_ptr<Flight> f) : flight(std::move(f)) {}
+	~FlightFollower() { flight->removeFollower(); }
+	FlightFollower(const FlightFollower&) = delete;
+	FlightFollower& operator=(const FlightFollower&) = delete;
+};
+
+// cacheStatus is set to "hit-memory", "hit-disk", "miss", "coalesced" (joined an identical running
+// request) or "bypass" (request not reusable); viewFactorKey to the kept run's key, or "" if none.
+// A successful result is encoded as `encoding`; errors are always JSON.
+static std::string runParsedCalculation(JsonInput in, CancelToken* cancel, bool& ok, std::string& cacheStatus,
+                                        std::string& viewFactorKey, ResultEncoding encoding = ResultEncoding::Json) {
+	cacheStatus = "bypass";
+	viewFactorKey.clear();
+	prepareDerivedOutput(in);
+	std::string cacheKey;
+	if (isReusableRequest(in)) {
+		cacheKey = computeRequestKey(in);
+		const char* tier = "miss";
+		auto cached = g_resultCache.lookup(cacheKey, tier);
+		cacheStatus = cached ? std::string("hit-") + tier : "miss";
+		if (cached) {
+			viewFactorKey = computeGeometryKey(in);
+			if (!findTracedRun(viewFactorKey)) viewFactorKey.clear();
+			ok = true;
+			return formatCalculationResult(*cached, viewFactorKey, encoding, in.output);
+		}
+	}
+
+	std::shared_ptr<Flight> flight;
+	std::unique_ptr<FlightLeader> leading;
+	if (!cacheKey.empty()) {
+		bool leader = false;
+		flight = g_flights.join(cacheKey, cacheKey, leader);
+		if (!leader) {
+			FlightFollower following(flight);
+			cacheStatus = "coalesced";
+			while (!flight->waitDone(std::chrono::milliseconds(100))) {
+				if (cancel && cancel->poll()) {
+					ok = false;
+					return std::string("{\"error\": \"calculation cancelled: ") + cancel->why() + "\"}";
+				}
+			}
+			return flight->result(ok, viewFactorKey, encoding, in.output);
+		}
+		leading = std::make_unique<FlightLeader>(flight, cacheKey);
+		// Keep computing for followers after this request's own client has gone
+		if (cancel) {
+			auto ownClientAlive = cancel->isConsumerAlive;
+			cancel->isConsumerAlive = [ownClientAlive, flight]() {
+				return !ownClientAlive || ownClientAlive() || flight->hasFollowers();
+			};
+		}
+	}
+
+	std::mt19937_64 rng;
+	if (in.seed.has_value()) {
+		rng.seed(in.seed.value());
+	} else {
+		std::random_device rd;
+		std::seed_seq seedSeq{rd(), rd(), rd(), rd(), rd(), rd()};
+		rng = std::mt19937_64(seedSeq);
+	}
+
+	PlaneResults planes;
+	ViewFactorMatrix viewFactors;
+	const bool finished = runReceiverPlanes(in, rng, cancel, [&](const std::string& planeName, const PlaneData& planeData,
+	                                                       const std::vector<double>& planeTemperatures, size_t idx1,
+	                                                       size_t totalPlanes) {
+		planes.push_back({planeName, planeData, planeTemperatures});
+		if (flight) {
+			StreamEvent ev;
+			ev.planeName = planeName;
+			ev.planeData = planeData;
+			ev.values = planeTemperatures;
+			ev.planeIndex1Based = idx1;
+			ev.totalPlanes = totalPlanes;
+			flight->append(makeFlightEvent(std::move(ev)));
+		}
+		return true;
+	}, nullptr, &viewFactors);
+
+	if (!finished) {
+		ok = false;
+		const std::string message = cancel && cancel->cancelled.load() ? std::string("calculation cancelled: ") + cancel->why()
+		                                                               : std::string("calculation interrupted");
+		if (flight) flight->fail(message);
+		return "{\"error\": \"" + message + "\"}";
+	}
+
+	ok = true;
+	const OutputOptions output = in.output;
+	viewFactorKey = rememberTracedRun(std::move(in), std::move(viewFactors), rng);
+	std::string body = formatCalculationResult(planes, viewFactorKey, encoding, output);
+	if (!cacheKey.empty()) {
+		flight->succeed(g_resultCache.insert(cacheKey, std::move(planes)), viewFactorKey);
+	}
+	return body;
+}
+
+static std::string runCalculation(const std::string& body, const std::string& contentType, CancelToken* cancel, bool& ok,
+                                  std::string& cacheStatus, ResultEncoding encoding = ResultEncoding::Json) {
+	JsonInput in;
+	std::string err;
+	cacheStatus = "bypass";
+	if (!parseRequestBody(body, contentType, in, err, parseThreadCount())) {
+		ok = false;
+		return std::string("{\"error\": \"") + jsonEscapeStringValue(err) + "\"}";
+	}
+	std::string viewFactorKey;
+	return runParsedCalculation(std::move(in), cancel, ok, cacheStatus, viewFactorKey, encoding);
+}
+
+// Streams another request's flight from log entry `first`: the events it sent so far, then the
+// rest as they come. Cancelling this request's job only detaches it.
+static void serveFlightFollowerStream(const httplib::Request& req, httplib::Response& res, std::shared_ptr<Flight> flight,
+                                      size_t totalPlanes, const OutputOptions& output,
+                                      std::function<void(const std::string&)> onFinished, size_t first = 0) {
+	using httplib::DataSink;
+	auto following = std::make_shared<FlightFollower>(std::move(flight));
+	auto runOnce = std::make_shared<bool>(false);
+	auto scope = std::make_shared<JobScope>(g_jobs.start(req.get_header_value("X-Job-Id")));
+	const ResultEncoding encoding = negotiateResultEncoding(req);
+
+	res.status = 200;
+	res.set_header("Cache-Control", "no-cache");
+	res.set_header("X-Job-Id", scope->job->id);
+	res.set_header("X-Cache", first > 0 ? "resumed" : "coalesced");
+
+	res.set_chunked_content_provider(
+		streamContentType(encoding),
+		[following, runOnce, scope, totalPlanes, onFinished, first, encoding, output](size_t /*offset*/, DataSink& sink) -> bool {
+			if (*runOnce) {
+				sink.done();
+				return true;
+			}
+			*runOnce = true;
+			Flight& flight = *following->flight;
+			CancelToken& cancel = scope->job->cancel;
+			std::string started = encoding == ResultEncoding::Json ? std::string() : resultHeader(encoding);
+			appendStreamEvent(started, encoding, output, "started", "", nullptr,
+			                  "{\"totalPlanes\":" + std::to_string(totalPlanes) + ",\"jobId\":\"" +
+			                      jsonEscapeStringValue(scope->job->id) + "\"" + (first > 0 ? ",\"resumed\":true}" : ",\"coalesced\":true}"));
+			bool clientOk = sink.write(started.c_str(), started.size());
+			bool ended = false;
+			for (size_t next = first; clientOk && !ended;) {
+				if (cancel.poll()) {
+					std::string msg;
+					appendStreamEvent(msg, encoding, output, "error", "", nullptr,
+					                  std::string("{\"message\":\"calculation cancelled: ") + cancel.why() + "\"}");
+					sink.write(msg.c_str(), msg.size());
+					break;
+				}
+				auto e = flight.waitEvent(next, std::chrono::milliseconds(100), ended);
+				if (e) {
+					const std::string& message = e->message(encoding, output);
+					clientOk = sink.write(message.c_str(), message.size());
+					++next;
+				} else if (!ended) {
+					clientOk = sink.is_writable();
+				}
+			}
+			if (ended && onFinished) {
+				bool ok = false;
+				std::string viewFactorKey;
+				flight.result(ok, viewFactorKey);
+				if (ok) onFinished(viewFactorKey);
+			}
+			sink.done();
+			return true;
+		});
+}
+
+// ===== Streaming ingest: trace receiver planes while the request body is still uploading =====
+
+static constexpr size_t kStreamIngestMinBytes = size_t {1} << 20; // smaller bodies are read whole first
+
+static std::atomic<std::uint64_t> g_ingestStreamed {0};    // bodies parsed as they arrived
+static std::atomic<std::uint64_t> g_ingestTracedEarly {0}; // ... whose planes were traced during the upload
+
+// Incremental parser for a calculation request arriving in pieces. A structural scan of each new
+// piece keeps the offsets just past the latest top-level (depth 1) and plane-level (depth 2)
+// delimiter; whatever ends before them is complete, so members are parsed once their value is in
+// and each receiver plane as soon as its closing brace is.
+class IngestParser {
+public:
+	// A receiver plane was parsed; its points are input().receiverPoints[firstPoint, + numPoints)
+	std::function<void(const std::string& name, const PlaneData& planeData, size_t firstPoint)> onPlane;
+	// A member came after receiver_planes, so planes were parsed before it was known; called once
+	std::function<void()> onMemberAfterPlanes;
+
+	// false once the body is malformed
+	bool feed(const char* data, size_t len) {
+		if (failed_) return false;
+		const size_t from = body_.size();
+		body_.append(data, len);
+		scan(from);
+		return advance();
+	}
+
+	// The whole body has arrived: checks it like parseInputJson and hands over the input
+	bool finish(JsonInput& out, std::string& error) {
+		if (!failed_ && state_ != State::Done) fail("Malformed JSON near offset " + std::to_string(pos_));
+		if (failed_) {
+			error = error_;
+			return false;
+		}
+		if (!checkParsedInput(in_, haveReceiverPlanes_, havePolygons_, error)) return false;
+		out = std::move(in_);
+		return true;
+	}
+
+	const JsonInput& input() const { return in_; }
+	bool havePolygons() const { return havePolygons_; }
+	// Planes arrived in the order the calculation visits them (strictly increasing names)
+	bool planesInOrder() const { return planesInOrder_; }
+
+private:
+	enum class State { Start, Members, Planes, AfterPlanes, Done };
+
+	void scan(size_t from) {
+		const std::array<bool, 256>& structural = mini_json::structuralChars();
+		const char* data = body_.data();
+		const size_t size = body_.size();
+		for (size_t i = from; i < size; ++i) {
+			if (inString_) {
+				const void* close = std::memchr(data + i, '"', size - i);
+				if (!close) return;
+				i = static_cast<size_t>(static_cast<const char*>(close) - data);
+				inString_ = false;
+				continue;
+			}
+			while (i < size && !structural[static_cast<unsigned char>(data[i])]) ++i;
+			if (i >= size) return;
+			switch (data[i]) {
+			case '"': inString_ = true; break;
+			case '[': case '{': ++depth_; break;
+			case ']': case '}':
+				if (depth_ > 0) --depth_;
+				if (depth_ == 0) safeTop_ = i + 1;
+				else if (depth_ == 1) safePlanes_ = i + 1;
+				break;
+			default: // ','
+				if (depth_ == 1) safeTop_ = i + 1;
+				else if (depth_ == 2) safePlanes_ = i + 1;
+				break;
+			}
+		}
+	}
+
+	bool advance() {
+		using mini_json::Reader;
+		while (true) {
+			Reader r(body_, pos_);
+			if (state_ == State::Done || r.atEnd()) return true;
+			switch (state_) {
+			case State::Start:
+				if (!r.expect('{')) return fail("Expected '{'");
+				state_ = State::Members;
+				break;
+			case State::Members: {
+				if (r.expect('}')) {
+					state_ = State::Done;
+					break;
+				}
+				std::string_view key;
+				if (!r.peek('"')) return fail("Malformed JSON near offset " + std::to_string(pos_));
+				if (!r.string(key) || r.atEnd()) return true;
+				if (!r.expect(':')) return fail("Malformed JSON near offset " + std::to_string(r.offset()));
+				if (key == "receiver_planes") {
+					if (r.atEnd()) return true;
+					if (!r.expect('{')) return fail("Invalid receiver_planes");
+					haveReceiverPlanes_ = true;
+					state_ = State::Planes;
+					break;
+				}
+				if (safeTop_ <= r.offset()) return true; // value still arriving
+				Reader value(body_, r.offset(), safeTop_);
+				if (!readInputMember(value, key, in_, havePolygons_, error_)) return fail(error_);
+				if (haveReceiverPlanes_ && !membersAfterPlanes_) {
+					membersAfterPlanes_ = true;
+					if (onMemberAfterPlanes) onMemberAfterPlanes();
+				}
+				if (value.expect('}')) state_ = State::Done;
+				else if (!value.expect(',')) return fail("Malformed JSON near offset " + std::to_string(value.offset()));
+				r = value;
+				break;
+			}
+			case State::Planes: {
+				if (r.expect('}')) {
+					state_ = State::AfterPlanes;
+					break;
+				}
+				if (safePlanes_ <= pos_) return true; // plane still arriving
+				Reader plane(body_, pos_, safePlanes_);
+				std::string_view name;
+				PlaneData pd {};
+				const size_t first = in_.receiverPoints.size();
+				if (!plane.string(name) || !plane.expect(':') || !mini_json::readReceiverPlane(plane, pd, in_.receiverPoints)) {
+					return fail("Invalid receiver_planes");
+				}
+				std::string planeName(name);
+				if (!in_.planeDataMap.empty() && planeName <= in_.planeDataMap.rbegin()->first) planesInOrder_ = false;
+				in_.planeDataMap[planeName] = pd;
+				if (onPlane) onPlane(planeName, pd, first);
+				if (plane.expect('}')) state_ = State::AfterPlanes;
+				else if (!plane.expect(',')) return fail("Invalid receiver_planes");
+				r = plane;
+				break;
+			}
+			case State::AfterPlanes:
+				if (r.expect('}')) state_ = State::Done;
+				else if (r.expect(',')) state_ = State::Members;
+				else return fail("Malformed JSON near offset " + std::to_string(pos_));
+				break;
+			case State::Done:
 				break;
 			}
+			pos_ = r.offset();
+		}
+	}
+
+	bool fail(const std::string& why) {
+		if (!failed_) error_ = why;
+		failed_ = true;
+		return false;
+	}
+
+	std::string body_;
+	JsonInput in_;
+	State state_ {State::Start};
+	size_t pos_ {0};
+	size_t depth_ {0};
+	bool inString_ {false};
+	size_t safeTop_ {0};
+	size_t safePlanes_ {0};
+	bool haveReceiverPlanes_ {false};
+	bool havePolygons_ {false};
+	bool planesInOrder_ {true};
+	bool membersAfterPlanes_ {false};
+	bool failed_ {false};
+	std::string error_;
+};
+
+// Receiver planes traced in arrival order while the body uploads. Each plane runs as its own
+// sub-request continuing the global point index (like a shard), so when planes arrive in name order
+// the values are exactly a normal run's. serveCalculationStream replays them with drain().
+class IngestTrace {
+public:
+	explicit IngestTrace(const JsonInput& scene) {
+		sub_.polygons = scene.polygons;
+		sub_.inertPolygons = scene.inertPolygons;
+		sub_.numRays = scene.numRays;
+		sub_.seed = scene.seed;
+		sub_.compiledScene = std::make_shared<const CompiledScene>(compileScene(sub_.polygons, sub_.inertPolygons));
+		if (scene.seed.has_value()) {
+			rng_.seed(scene.seed.value());
+		} else {
+			std::random_device rd;
+			std::seed_seq seedSeq{rd(), rd(), rd(), rd(), rd(), rd()};
+			rng_ = std::mt19937_64(seedSeq);
+		}
+		viewFactors_.numRays = scene.numRays;
+		viewFactors_.numEmitters = scene.polygons.size();
+		startedAt_ = std::chrono::steady_clock::now();
+		thread_ = std::thread([this]() { run(); });
+	}
+	~IngestTrace() { abandon(); }
+
+	void add(const std::string& name, const PlaneData& planeData, const ReceiverPoint* points) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.push_back({name, planeData, std::vector<ReceiverPoint>(points, points + planeData.numPoints)});
+		changed_.notify_all();
+	}
+	// The body is complete: no more planes
+	void close() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		closed_ = true;
+		changed_.notify_all();
+	}
+	void abandon() {
+		cancel_.cancel("request abandoned");
+		close();
+		if (thread_.joinable()) thread_.join();
+	}
+
+	// Passes every plane to onPlaneDone in order as it finishes, with progress while waiting. True
+	// once all totalPlanes were traced; viewFactors and rng then continue as a normal run's would.
+	bool drain(CancelToken& cancel, size_t totalPlanes, size_t totalPoints, const ReceiverPlaneDoneFn& onPlaneDone,
+	           const ProgressFn& onProgress, ViewFactorMatrix& viewFactors, std::mt19937_64& rng) {
+		for (size_t next = 0;;) {
+			PlaneResult plane;
+			bool havePlane = false;
+			ProgressInfo p {};
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				changed_.wait_for(lock, std::chrono::milliseconds(kProgressIntervalMs),
+				                  [&]() { return done_.size() > next || finished_; });
+				if (done_.size() > next) {
+					plane = std::move(done_[next]);
+					havePlane = true;
+				} else if (finished_) {
+					break;
+				} else {
+					p.pointsDone = pointsDone_;
+					p.totalPoints = totalPoints;
+					p.raysTraced = static_cast<std::uint64_t>(pointsDone_) * sub_.numRays;
+					p.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startedAt_).count();
+					p.raysPerSecond = p.elapsedSeconds > 0.0 ? static_cast<double>(p.raysTraced) / p.elapsedSeconds : 0.0;
+					const double raysLeft = static_cast<double>(totalPoints - std::min(pointsDone_, totalPoints)) * sub_.numRays;
+					p.etaSeconds = p.raysPerSecond > 0.0 ? raysLeft / p.raysPerSecond : -1.0;
+					p.planeIndex1Based = next + 1;
+					p.totalPlanes = totalPlanes;
+				}
+			}
+			if (cancel.poll()) {
+				abandon();
+				return false;
+			}
+			if (havePlane) {
+				++next;
+				if (!onPlaneDone(plane.name, plane.planeData, plane.values, next, totalPlanes)) {
+					abandon();
+					return false;
+				}
+			} else if (onProgress && !onProgress(p)) {
+				abandon();
+				return false;
+			}
+		}
+		if (thread_.joinable()) thread_.join();
+		if (failed_ || done_.size() != totalPlanes) return false;
+		viewFactors = viewFactorsComplete_ ? std::move(viewFactors_) : ViewFactorMatrix();
+		rng = rng_;
+		return true;
+	}
+
+private:
+	struct PendingPlane {
+		std::string name;
+		PlaneData planeData;
+		std::vector<ReceiverPoint> points;
+	};
+
+	void run() {
+		size_t offset = 0;
+		bool ok = true;
+		while (ok) {
+			PendingPlane plane;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				changed_.wait(lock, [this]() { return !pending_.empty() || closed_; });
+				if (pending_.empty() || cancel_.cancelled.load()) break;
+				plane = std::move(pending_.front());
+				pending_.pop_front();
+			}
+			sub_.planeDataMap.clear();
+			sub_.planeDataMap[plane.name] = plane.planeData;
+			sub_.receiverPoints = std::move(plane.points);
+			sub_.pointIndexOffset = offset;
+			std::vector<double> values;
+			ViewFactorMatrix planeFactors;
+			ok = runReceiverPlanes(
+				sub_, rng_, &cancel_,
+				[&values](const std::string&, const PlaneData&, const std::vector<double>& planeTemperatures, size_t, size_t) {
+					values = planeTemperatures;
+					return true;
+				},
+				[&](const ProgressInfo& p) {
+					std::lock_guard<std::mutex> lock(mutex_);
+					pointsDone_ = offset + p.pointsDone;
+					return true;
+				},
+				&planeFactors);
+			offset += plane.planeData.numPoints;
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!ok) break;
+			if (planeFactors.rows() == plane.planeData.numPoints && planeFactors.numEmitters == viewFactors_.numEmitters) {
+				const std::uint64_t base = viewFactors_.emitter.size();
+				for (size_t row = 1; row <= planeFactors.rows(); ++row) viewFactors_.rowStart.push_back(base + planeFactors.rowStart[row]);
+				viewFactors_.emitter.insert(viewFactors_.emitter.end(), planeFactors.emitter.begin(), planeFactors.emitter.end());
+				viewFactors_.hits.insert(viewFactors_.hits.end(), planeFactors.hits.begin(), planeFactors.hits.end());
+			} else {
+				viewFactorsComplete_ = false;
+			}
+			done_.push_back({plane.name, plane.planeData, std::move(values)});
+			pointsDone_ = offset;
+			changed_.notify_all();
+		}
+		std::lock_guard<std::mutex> lock(mutex_);
+		failed_ = !ok;
+		finished_ = true;
+		changed_.notify_all();
+	}
+
+	JsonInput sub_; // scene plus the plane being traced
+	std::mt19937_64 rng_;
+	CancelToken cancel_;
+	std::chrono::steady_clock::time_point startedAt_;
+	std::mutex mutex_;
+	std::condition_variable changed_;
+	std::deque<PendingPlane> pending_;
+	PlaneResults done_;
+	ViewFactorMatrix viewFactors_;
+	bool viewFactorsComplete_ {true};
+	size_t pointsDone_ {0};
+	bool closed_ {false};
+	bool finished_ {false};
+	bool failed_ {false};
+	std::thread thread_;
+};
+
+// Reads a /calculate/stream body. A large one is parsed as it arrives, and when the scene comes
+// first (emitters before receiver_planes, no progressive or base) each receiver plane starts
+// tracing as soon as it is complete; traced then carries those planes to serveCalculationStream.
+// Binary bodies are read whole: decoding one is a copy, not worth overlapping with the upload.
+static bool ingestCalculationRequest(const httplib::Request& req, const httplib::ContentReader& content, JsonInput& in,
+                                     std::shared_ptr<IngestTrace>& traced, std::string& error) {
+	const std::string length = req.get_header_value("Content-Length");
+	const std::string contentType = req.get_header_value("Content-Type");
+	if ((!length.empty() && std::strtoull(length.c_str(), nullptr, 10) < kStreamIngestMinBytes) || req.has_header("Last-Event-ID") ||
+	    isBinaryRequest(contentType)) {
+		std::string body;
+		if (!content([&body](const char* data, size_t len) {
+			    body.append(data, len);
+			    return true;
+		    })) {
+			error = "Could not read request body";
+			return false;
+		}
+		return parseRequestBody(body, contentType, in, error, parseThreadCount());
+	}
+
+	++g_ingestStreamed;
+	IngestParser parser;
+	std::shared_ptr<IngestTrace> trace;
+	bool tracing = true;
+	parser.onPlane = [&](const std::string& name, const PlaneData& planeData, size_t firstPoint) {
+		const JsonInput& scene = parser.input();
+		if (!tracing) return;
+		if (!parser.planesInOrder() || !parser.havePolygons() || scene.progressive || !scene.baseKey.empty()) {
+			tracing = false;
+			trace.reset();
+			return;
+		}
+		if (!trace) trace = std::make_shared<IngestTrace>(scene);
+		trace->add(name, planeData, scene.receiverPoints.data() + firstPoint);
+	};
+	// The planes already traced may not match the scene any more; stop them right away
+	parser.onMemberAfterPlanes = [&]() {
+		tracing = false;
+		trace.reset();
+	};
+	const bool received = content([&parser](const char* data, size_t len) { return parser.feed(data, len); });
+	if (!parser.finish(in, error)) return false;
+	if (!received) {
+		error = "Could not read request body";
+		return false;
+	}
+	if (trace && tracing) {
+		trace->close();
+		traced = std::move(trace);
+		++g_ingestTracedEarly;
+	}
+	return true;
+}
+
+// Streams a parsed calculation as SSE: "started", one "plane" per finished receiver plane with
+// throttled "progress" in between, then "complete" or "error". onFinished, if set, receives the
+// viewFactorKey of a successful run ("" if none was kept). ingested: planes already being traced
+// while the body uploaded; they are used only if this request ends up tracing at all.
+static void serveCalculationStream(const httplib::Request& req, httplib::Response& res, JsonInput in,
+                                   std::function<void(const std::string& viewFactorKey)> onFinished = nullptr,
+                                   std::shared_ptr<IngestTrace> ingested = nullptr) {
+	using httplib::DataSink;
+	prepareDerivedOutput(in);
+	// Progressive runs are neither cached, shared nor resumable: their final rays depend on when they stopped
+	const std::string requestKey = in.progressive ? std::string() : computeRequestKey(in);
+
+	// A reconnect naming an event of this same request picks up right after it
+	const std::string lastEventId = req.get_header_value("Last-Event-ID");
+	const size_t colon = lastEventId.rfind(':');
+	if (!requestKey.empty() && colon != std::string::npos && colon + 1 < lastEventId.size() &&
+	    lastEventId.find_first_not_of("0123456789", colon + 1) == std::string::npos) {
+		if (auto flight = g_flights.resume(lastEventId.substr(0, colon), requestKey)) {
+			const size_t first = static_cast<size_t>(std::strtoull(lastEventId.c_str() + colon + 1, nullptr, 10)) + 1;
+			serveFlightFollowerStream(req, res, std::move(flight), in.planeDataMap.size(), in.output, std::move(onFinished), first);
+			return;
+		}
+	}
+
+	// A reusable request already answered is replayed as plane events without tracing
+	std::string cacheKey;
+	std::shared_ptr<const PlaneResults> cached;
+	std::string cacheStatus = "bypass";
+	if (isReusableRequest(in) && !in.progressive) {
+		cacheKey = requestKey;
+		const char* tier = "miss";
+		cached = g_resultCache.lookup(cacheKey, tier);
+		cacheStatus = cached ? std::string("hit-") + tier : "miss";
+	}
+
+	// Every traced stream runs as a flight so it can be resumed; an identical reusable request
+	// already tracing is followed instead of traced again
+	std::shared_ptr<FlightLeader> leading;
+	if (!requestKey.empty() && !cached) {
+		bool leader = false;
+		auto flight = g_flights.join(cacheKey, requestKey, leader);
+		if (!leader) {
+			serveFlightFollowerStream(req, res, std::move(flight), in.planeDataMap.size(), in.output, std::move(onFinished));
+			return;
+		}
+		leading = std::make_shared<FlightLeader>(std::move(flight), cacheKey);
+	}
+	if (cached) ingested.reset();
+
+	std::mt19937_64 rng;
+	if (in.seed.has_value()) {
+		rng.seed(in.seed.value());
+	} else {
+		std::random_device rd;
+		std::seed_seq seedSeq{rd(), rd(), rd(), rd(), rd(), rd()};
+		rng = std::mt19937_64(seedSeq);
+	}
+
+	auto inPtr = std::make_shared<JsonInput>(std::move(in));
+	auto rngPtr = std::make_shared<std::mt19937_64>(std::move(rng));
+	auto runOnce = std::make_shared<bool>(false);
+	auto scope = std::make_shared<JobScope>(g_jobs.start(req.get_header_value("X-Job-Id")));
+	const ResultEncoding encoding = negotiateResultEncoding(req);
+	const OutputOptions output = inPtr->output;
+
+	res.status = 200;
+	res.set_header("Cache-Control", "no-cache");
+	res.set_header("X-Job-Id", scope->job->id);
+	res.set_header("X-Cache", cacheStatus);
+
+	res.set_chunked_content_provider(
+		streamContentType(encoding),
+		[inPtr, rngPtr, runOnce, scope, cacheKey, cached, onFinished, leading, ingested, encoding,
+		 output](size_t /*offset*/, DataSink& sink) mutable -> bool {
+			if (*runOnce) {
+				sink.done();
+				return true;
+			}
+			*runOnce = true;
+
+			// Every event goes out as SSE or as a binary frame, formatted into one buffer reused for the
+			// whole stream; a binary stream opens with its header
+			std::string pending = encoding == ResultEncoding::Json ? std::string() : resultHeader(encoding);
+			auto sendEvent = [&](const char* eventName, const StreamEvent* payload, const std::string& data = std::string(),
+			                     const std::string& id = std::string(), size_t rowsSent = 0) -> bool {
+				appendStreamEvent(pending, encoding, output, eventName, id, payload, data, rowsSent);
+				const bool written = sink.write(pending.c_str(), pending.size());
+				pending.clear();
+				return written;
+			};
+			auto sendSse = [&](const char* eventName, const std::string& data) { return sendEvent(eventName, nullptr, data); };
+
+			CancelToken& cancel = scope->job->cancel;
+			const size_t totalPlanes = inPtr->planeDataMap.size();
+
+			if (!sendSse("started", std::string("{\"totalPlanes\":") + std::to_string(totalPlanes) +
+			                            ",\"jobId\":\"" + jsonEscapeStringValue(scope->job->id) + "\"" +
+			                            (cached ? ",\"cached\":true}" : "}"))) {
+				sink.done();
+				return true;
+			}
+
+			if (cached) {
+				bool written = true;
+				for (size_t k = 0; k < cached->size() && written; ++k) {
+					StreamEvent e;
+					e.kind = StreamEvent::Kind::Plane;
+					e.planeName = (*cached)[k].name;
+					e.planeData = (*cached)[k].planeData;
+					e.values = (*cached)[k].values;
+					e.planeIndex1Based = k + 1;
+					e.totalPlanes = cached->size();
+					written = sendEvent("plane", &e);
+				}
+				std::string geometryKey = computeGeometryKey(*inPtr);
+				if (!findTracedRun(geometryKey)) geometryKey.clear();
+				if (onFinished) onFinished(geometryKey);
+				if (written) {
+					sendSse("complete", formatCompleteEventJson(geometryKey));
+				}
+				sink.done();
+				return true;
+			}
+
+			// Compute runs on its own thread and hands raw results to this (writer) thread, which
+			// formats and writes them; a slow client only ever fills the bounded queue.
+			SpscQueue<StreamEvent> queue(kStreamQueueCapacity);
+			std::atomic<bool> computeDone {false};
+			bool computeOk = false;
+			PlaneResults finishedPlanes; // kept only when the result will be cached
+			ViewFactorMatrix viewFactors;
+			std::string stopReason; // progressive mode
+
+			std::thread compute([&]() {
+				// Waits for the writer to make room; wakes every kStreamLivenessInterval to notice cancellation
+				auto pushBlocking = [&](StreamEvent& ev) -> bool {
+					while (!queue.tryPush(ev)) {
+						if (cancel.poll()) return false;
+						queue.waitUntil(std::chrono::steady_clock::now() + kStreamLivenessInterval, [&]() { return !queue.full(); });
+					}
+					return true;
+				};
+				auto finish = [&]() {
+					computeDone.store(true, std::memory_order_release);
+					queue.notify();
+				};
+				if (inPtr->progressive) {
+					computeOk = processReceiverPlanesProgressive(
+						*inPtr, *rngPtr, &cancel,
+						[&](const std::string& planeName, const PlaneData& planeData, const std::vector<double>& values,
+						    size_t planeIndex1Based, size_t nPlanes, const RefinementStatus& status) {
+							StreamEvent ev;
+							ev.kind = StreamEvent::Kind::Plane;
+							ev.planeName = planeName;
+							ev.planeData = planeData;
+							ev.values = values;
+							ev.planeIndex1Based = planeIndex1Based;
+							ev.totalPlanes = nPlanes;
+							ev.refined = true;
+							ev.refinement = status;
+							return pushBlocking(ev);
+						},
+						[&](const RefinementStatus& status) {
+							StreamEvent ev;
+							ev.kind = StreamEvent::Kind::Round;
+							ev.refined = true;
+							ev.refinement = status;
+							return pushBlocking(ev);
+						},
+						stopReason);
+					finish();
+					return;
+				}
+				auto onPlane = [&](const std::string& planeName, const PlaneData& planeData, const std::vector<double>& planeTemperatures,
+				                   size_t planeIndex1Based, size_t nPlanes) {
+					if (!cacheKey.empty()) {
+						finishedPlanes.push_back({planeName, planeData, planeTemperatures});
+					}
+					StreamEvent ev;
+					ev.kind = StreamEvent::Kind::Plane;
+					ev.planeName = planeName;
+					ev.planeData = planeData;
+					ev.values = planeTemperatures;
+					ev.planeIndex1Based = planeIndex1Based;
+					ev.totalPlanes = nPlanes;
+					return pushBlocking(ev);
+				};
+				auto onProgress = [&](const ProgressInfo& p) {
+					// Progress is advisory: drop it rather than wait on a full queue
+					StreamEvent ev;
+					ev.kind = StreamEvent::Kind::Progress;
+					ev.progress = p;
+					queue.tryPush(ev);
+					return !cancel.poll();
+				};
+				// A tile goes out once tileRows rows are done, or the plane is; like planes it waits for
+				// room in the queue, so only a few tiles are ever held for a slow client
+				size_t tilePlane = 0, tileStart = 0;
+				auto onRows = [&](const std::string& planeName, const PlaneData& planeData, const std::vector<double>& valuesSoFar,
+				                  size_t planeIndex1Based, size_t nPlanes) {
+					if (planeIndex1Based != tilePlane) {
+						tilePlane = planeIndex1Based;
+						tileStart = 0;
+					}
+					const size_t tilePoints = planeTileColumns(planeData) * output.tileRows;
+					if (valuesSoFar.size() - tileStart < tilePoints && valuesSoFar.size() < planeData.numPoints) return true;
+					StreamEvent ev;
+					ev.kind = StreamEvent::Kind::Tile;
+					ev.planeName = planeName;
+					ev.planeData = planeData;
+					ev.offset = tileStart;
+					ev.values.assign(valuesSoFar.begin() + static_cast<std::ptrdiff_t>(tileStart), valuesSoFar.end());
+					ev.planeIndex1Based = planeIndex1Based;
+					ev.totalPlanes = nPlanes;
+					tileStart = valuesSoFar.size();
+					return pushBlocking(ev);
+				};
+				computeOk = ingested ? ingested->drain(cancel, totalPlanes, inPtr->receiverPoints.size(), onPlane, onProgress,
+				                                       viewFactors, *rngPtr)
+				                     : runReceiverPlanes(*inPtr, *rngPtr, &cancel, onPlane, onProgress, &viewFactors,
+				                                         sendsTiles(output) ? PlaneRowsFn(onRows) : nullptr);
+				finish();
+			});
+
+			Flight* flight = leading ? leading->flight.get() : nullptr;
+			bool clientOk = true;
+			// Without its client the flight keeps computing while anyone follows it, and for the resume
+			// window after that in case the client reconnects
+			std::optional<std::chrono::steady_clock::time_point> orphanedSince;
+			auto checkOrphaned = [&](std::chrono::steady_clock::time_point now) {
+				if (clientOk || (flight && flight->hasFollowers())) {
+					orphanedSince.reset();
+					return;
+				}
+				if (!orphanedSince) orphanedSince = now;
+				if (!flight || now - *orphanedSince >= g_flights.resumeWindow()) cancel.cancel("client disconnected");
+			};
+			auto dropClient = [&]() {
+				clientOk = false;
+				checkOrphaned(std::chrono::steady_clock::now());
+			};
+			size_t rowsSent = 0; // rows of the current plane this client already has as tiles
+			auto writeEvent = [&](StreamEvent& e) {
+				bool written = true;
+				const bool plane = e.kind == StreamEvent::Kind::Plane;
+				if (e.kind == StreamEvent::Kind::Tile) {
+					// Tiles are not logged: followers and resumed streams get them cut from the plane event
+					rowsSent = (e.offset + e.values.size()) / std::max<size_t>(planeTileColumns(e.planeData), 1);
+					if (clientOk) written = sendEvent("tile", &e);
+				} else if (flight) {
+					// Formatted once into the flight log, then shared with every follower
+					auto logged = makeFlightEvent(std::move(e));
+					flight->append(logged);
+					if (clientOk && plane && rowsSent > 0) {
+						written = sendEvent(logged->name, &logged->payload, std::string(), logged->id, rowsSent);
+					} else if (clientOk) {
+						const std::string& message = logged->message(encoding, output);
+						written = sink.write(message.c_str(), message.size());
+					}
+				} else if (clientOk) {
+					written = sendEvent(plane                                ? "plane"
+					                    : e.kind == StreamEvent::Kind::Round ? "round"
+					                                                         : "progress",
+					                    &e, std::string(), std::string(), rowsSent);
+				}
+				if (plane) rowsSent = 0;
+				if (!written) dropClient();
+			};
+			auto lastLivenessCheck = std::chrono::steady_clock::now();
+			StreamEvent ev;
+			while (true) {
+				// Read the flag before popping: once set, an empty queue really means nothing is left
+				const bool finished = computeDone.load(std::memory_order_acquire);
+				if (queue.tryPop(ev)) {
+					writeEvent(ev); // without a client this just drains so compute can finish
+					continue;
+				}
+				if (finished) break;
+				// Idle: notice a vanished client between planes instead of at the next write
+				const auto now = std::chrono::steady_clock::now();
+				if (now - lastLivenessCheck >= kStreamLivenessInterval) {
+					lastLivenessCheck = now;
+					if (clientOk && !sink.is_writable()) clientOk = false;
+					checkOrphaned(now);
+				}
+				queue.waitUntil(lastLivenessCheck + kStreamLivenessInterval,
+				                [&]() { return !queue.empty() || computeDone.load(std::memory_order_acquire); });
+			}
+			compute.join();
+
+			std::shared_ptr<const PlaneResults> results;
+			if (computeOk && !cacheKey.empty()) {
+				results = g_resultCache.insert(cacheKey, std::move(finishedPlanes));
+			}
+			std::string viewFactorKey;
+			if (computeOk && !inPtr->progressive) {
+				viewFactorKey = rememberTracedRun(std::move(*inPtr), std::move(viewFactors), *rngPtr);
+				if (onFinished) onFinished(viewFactorKey);
+			}
+			const std::string failure = computeOk               ? std::string()
+			                            : cancel.cancelled.load() ? std::string("calculation cancelled: ") + cancel.why()
+			                                                      : std::string("calculation interrupted");
+			std::shared_ptr<FlightEvent> terminal;
+			if (flight) terminal = computeOk ? flight->succeed(results, viewFactorKey) : flight->fail(failure);
+
+			if (clientOk) {
+				if (terminal) {
+					sink.write(terminal->message(encoding, output).c_str(), terminal->message(encoding, output).size());
+				} else if (computeOk && !stopReason.empty()) {
+					sendSse("complete", "{\"success\":true,\"stopReason\":\"" + stopReason + "\"}");
+				} else if (computeOk) {
+					sendSse("complete", formatCompleteEventJson(viewFactorKey));
+				} else {
+					sendSse("error", "{\"message\":\"" + failure + "\"}");
+				}
+			}
+
+			sink.done();
+			return true;
+		},
+		[scope](bool /*success*/) {
+			// Connection finished or dropped; make sure nothing keeps computing for it
+			scope->job->cancel.cancel("client disconnected");
+		});
+}
+
+// ===== Scene sessions: upload a scene once, then apply small deltas =====
+
+// One edit of a session scene. Fields not used by an op stay empty.
+struct SessionOp {
+	std::string op;
+	std::string kind; // "emitter" or "inert"
+	std::string name;
+	std::optional<std::uint64_t> index;
+	std::optional<double> temperature;
+	std::optional<Vec3> offset;
+	bool havePolygon {false};
+	std::vector<Vec3> polygon;
+	std::map<std::string, std::pair<PlaneData, std::vector<ReceiverPoint>>> planes;
+};
+
+// {"ops": [{"op": ..., ...}, ...]}. Unknown members are skipped, as in calculation requests.
+static bool parseSessionOps(const std::string& json, std::vector<SessionOp>& ops, std::string& error) {
+	using namespace mini_json;
+	Reader r(json);
+	bool haveOps = false;
+	size_t planePoints = 0; // across all set_receiver_planes ops
+	auto readOp = [&](SessionOp& op) {
+		return r.object([&](std::string_view key) {
+			bool valid = true;
+			std::string_view text;
+			if (key == "op") {
+				valid = r.string(text);
+				op.op = std::string(text);
+			} else if (key == "kind") {
+				valid = r.string(text);
+				op.kind = std::string(text);
+			} else if (key == "name") {
+				valid = r.string(text);
+				op.name = std::string(text);
+			} else if (key == "index") {
+				std::uint64_t v = 0;
+				valid = r.uint64(v);
+				op.index = v;
+			} else if (key == "temperature") {
+				double v = 0.0;
+				valid = r.number(v);
+				op.temperature = v;
+			} else if (key == "offset") {
+				Vec3 v;
+				valid = r.vec3(v);
+				op.offset = v;
+			} else if (key == "polygon") {
+				op.havePolygon = true;
+				valid = readPolygon(r, op.polygon);
+			} else if (key == "receiver_planes") {
+				// Planes parsed one by one so each keeps its own points whatever the key order
+				valid = r.object([&](std::string_view planeName) {
+					auto& plane = op.planes[std::string(planeName)];
+					planePoints -= plane.second.size();
+					plane.second.clear();
+					if (!readReceiverPlane(r, plane.first, plane.second, nullptr, planePoints)) return false;
+					planePoints += plane.second.size();
+					return true;
+				});
+			} else {
+				return r.skipValue();
+			}
+			if (!valid && error.empty()) error = "Invalid value for op field " + std::string(key);
+			return valid;
+		});
+	};
+	const bool ok = r.object([&](std::string_view key) {
+		if (key != "ops") return r.skipValue();
+		haveOps = true;
+		return r.array([&]() { return readOp(ops.emplace_back()); });
+	});
+	if (!ok) {
+		if (error.empty()) error = "Malformed JSON near offset " + std::to_string(r.offset());
+		return false;
+	}
+	if (!haveOps) {
+		error = "Expected {\"ops\": [...]}";
+		return false;
+	}
+	return true;
+}
 
-			const auto& receiverPoint = in.receiverPoints[globalPointIdx];
+struct Session {
+	std::string id;
+	std::mutex mutex; // guards everything below
+	JsonInput input;
+	std::shared_ptr<const CompiledScene> compiled; // null until the next calculation after a polygon edit
+	std::string lastViewFactorKey;                 // base for the next calculation
+	std::uint64_t version {0};
+	std::chrono::steady_clock::time_point lastUsed;
+	bool closed {false};                  // deleted or evicted; preview streams end
+	std::condition_variable changed;      // notified on every version bump and on close
+};
 
-			std::mt19937_64 pointRng = rng;
-			if (in.seed.has_value()) {
-				pointRng.seed(in.seed.value() + globalPointIdx * 12345);
-			}
+static void closeSession(Session& session) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	session.closed = true;
+	session.changed.notify_all();
+}
 
-			auto res = calculateViewFactorsWithBlockage(receiverPoint.origin, receiverPoint.normal, in.polygons, in.inertPolygons, in.numRays, pointRng);
+static constexpr size_t kMaxSessions = 64;
 
-			double totalTemperature = 0.0;
-			for (size_t p = 0; p < in.polygons.size(); ++p) {
-				double temperatureContribution = res.viewFactors[p] * in.polygons[p].temperature;
-				totalTemperature += temperatureContribution;
+class SessionRegistry {
+public:
+	std::shared_ptr<Session> create(JsonInput in) {
+		auto session = std::make_shared<Session>();
+		session->input = std::move(in);
+		session->lastUsed = std::chrono::steady_clock::now();
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::ostringstream id;
+		id << "sess-" << std::hex << rng_() << std::dec << "-" << ++counter_;
+		session->id = id.str();
+		sessions_[session->id] = session;
+		// Least recently used sessions go first; a running calculation keeps its own reference
+		while (sessions_.size() > kMaxSessions) {
+			auto oldest = sessions_.begin();
+			for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+				if (it->second->lastUsed < oldest->second->lastUsed) oldest = it;
 			}
+			closeSession(*oldest->second);
+			sessions_.erase(oldest);
+		}
+		return session;
+	}
+	std::shared_ptr<Session> find(const std::string& id) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = sessions_.find(id);
+		if (it == sessions_.end()) return nullptr;
+		it->second->lastUsed = std::chrono::steady_clock::now();
+		return it->second;
+	}
+	bool erase(const std::string& id) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto it = sessions_.find(id);
+		if (it == sessions_.end()) return false;
+		closeSession(*it->second);
+		sessions_.erase(it);
+		return true;
+	}
+	size_t size() {
+		std::lock_guard<std::mutex> lock(mutex_);
+		return sessions_.size();
+	}
 
-			planeTemperatures.push_back(totalTemperature);
+private:
+	std::mutex mutex_;
+	std::map<std::string, std::shared_ptr<Session>> sessions_;
+	std::mt19937_64 rng_ {std::random_device{}()};
+	std::uint64_t counter_ {0};
+};
 
-			if (totalTemperature < minTemp) minTemp = totalTemperature;
-			if (totalTemperature > maxTemp) maxTemp = totalTemperature;
+static SessionRegistry g_sessions;
 
-			globalPointIdx++;
-		}
+// Caller holds session.mutex
+static std::string sessionSummaryJson(const Session& session) {
+	std::ostringstream out;
+	out << "{\"sessionId\":\"" << session.id << "\"";
+	out << ",\"version\":" << session.version;
+	out << ",\"emitters\":" << session.input.polygons.size();
+	out << ",\"inertPolygons\":" << session.input.inertPolygons.size();
+	out << ",\"receiverPlanes\":" << session.input.planeDataMap.size();
+	out << ",\"receiverPoints\":" << session.input.receiverPoints.size() << "}";
+	return out.str();
+}
 
-		std::cout << "  Finished plane \"" << planeName << "\"" << std::endl;
-		std::cout << "    Temperature range: " << minTemp << " to " << maxTemp << std::endl;
-		std::cout << "    Next globalPointIdx: " << globalPointIdx << std::endl;
+// Applies all ops or none. Caller holds session.mutex.
+static bool applySessionOps(Session& session, const std::vector<SessionOp>& ops, std::string& error) {
+	JsonInput& in = session.input;
+	std::vector<PolygonWithTemp> emitters = in.polygons;
+	std::vector<std::vector<Vec3>> inert = in.inertPolygons;
+	std::map<std::string, std::pair<PlaneData, std::vector<ReceiverPoint>>> setPlanes;
+	std::vector<std::string> removedPlanes;
+	bool sceneChanged = false;
 
-		if (!onPlaneDone(planeName, planeData, planeTemperatures, planeIndex, totalPlanes)) {
+	for (size_t k = 0; k < ops.size(); ++k) {
+		const SessionOp& op = ops[k];
+		const std::string where = "op " + std::to_string(k) + " (" + op.op + "): ";
+		const bool isEmitter = op.kind == "emitter";
+		if ((op.op == "move_polygon" || op.op == "translate_polygon" || op.op == "add_polygon" || op.op == "remove_polygon") &&
+		    !isEmitter && op.kind != "inert") {
+			error = where + "kind must be \"emitter\" or \"inert\"";
+			return false;
+		}
+		const size_t count = isEmitter ? emitters.size() : inert.size();
+		auto needIndex = [&](size_t limit) {
+			if (op.index.has_value() && op.index.value() < limit) return true;
+			error = where + "index missing or out of range";
+			return false;
+		};
+		auto vertices = [&](size_t idx) -> std::vector<Vec3>& { return isEmitter ? emitters[idx].vertices : inert[idx]; };
+
+		if (op.op == "set_temperature") {
+			if (!needIndex(emitters.size())) return false;
+			if (!op.temperature.has_value()) { error = where + "missing temperature"; return false; }
+			emitters[op.index.value()].temperature = op.temperature.value();
+			sceneChanged = true;
+		} else if (op.op == "move_polygon") {
+			if (!needIndex(count)) return false;
+			if (!op.havePolygon) { error = where + "missing polygon"; return false; }
+			vertices(op.index.value()) = op.polygon;
+			sceneChanged = true;
+		} else if (op.op == "translate_polygon") {
+			if (!needIndex(count)) return false;
+			if (!op.offset.has_value()) { error = where + "missing offset"; return false; }
+			for (auto& v : vertices(op.index.value())) v += op.offset.value();
+			sceneChanged = true;
+		} else if (op.op == "add_polygon") {
+			if (!op.havePolygon) { error = where + "missing polygon"; return false; }
+			if (isEmitter) {
+				emitters.push_back({op.polygon, op.temperature.value_or(0.0)});
+			} else {
+				inert.push_back(op.polygon);
+			}
+			sceneChanged = true;
+		} else if (op.op == "remove_polygon") {
+			if (!needIndex(count)) return false;
+			if (isEmitter) {
+				emitters.erase(emitters.begin() + static_cast<std::ptrdiff_t>(op.index.value()));
+			} else {
+				inert.erase(inert.begin() + static_cast<std::ptrdiff_t>(op.index.value()));
+			}
+			sceneChanged = true;
+		} else if (op.op == "set_receiver_planes") {
+			if (op.planes.empty()) { error = where + "missing receiver_planes"; return false; }
+			for (const auto& kv : op.planes) {
+				setPlanes[kv.first] = kv.second;
+				removedPlanes.erase(std::remove(removedPlanes.begin(), removedPlanes.end(), kv.first), removedPlanes.end());
+			}
+		} else if (op.op == "remove_receiver_plane") {
+			const bool known = in.planeDataMap.count(op.name) > 0 || setPlanes.count(op.name) > 0;
+			if (!known) { error = where + "unknown receiver plane \"" + op.name + "\""; return false; }
+			setPlanes.erase(op.name);
+			removedPlanes.push_back(op.name);
+		} else {
+			error = where + "unknown op";
 			return false;
 		}
 	}
+
+	// Receiver points are stored flat in plane-name order; splice changed planes into a new array
+	if (!setPlanes.empty() || !removedPlanes.empty()) {
+		std::map<std::string, size_t> oldOffsets;
+		size_t offset = 0;
+		for (const auto& kv : in.planeDataMap) {
+			oldOffsets[kv.first] = offset;
+			offset += kv.second.numPoints;
+		}
+		std::map<std::string, PlaneData> planeMap = in.planeDataMap;
+		for (const auto& name : removedPlanes) planeMap.erase(name);
+		for (const auto& kv : setPlanes) planeMap[kv.first] = kv.second.first;
+		std::vector<ReceiverPoint> points;
+		for (const auto& kv : planeMap) {
+			auto replaced = setPlanes.find(kv.first);
+			if (replaced != setPlanes.end()) {
+				points.insert(points.end(), replaced->second.second.begin(), replaced->second.second.end());
+			} else {
+				const auto first = in.receiverPoints.begin() + static_cast<std::ptrdiff_t>(oldOffsets[kv.first]);
+				points.insert(points.end(), first, first + static_cast<std::ptrdiff_t>(kv.second.numPoints));
+			}
+		}
+		if (points.empty()) { error = "session would have no receiver points"; return false; }
+		if (points.size() > kMaxReceiverPoints) { error = "session would have too many receiver points"; return false; }
+		in.planeDataMap = std::move(planeMap);
+		in.receiverPoints = std::move(points);
+	}
+
+	in.polygons = std::move(emitters);
+	in.inertPolygons = std::move(inert);
+	// Temperatures live in the compiled scene too, so any emitter edit rebuilds it
+	if (sceneChanged) session.compiled.reset();
+	++session.version;
+	session.changed.notify_all();
 	return true;
 }
 
-static std::string runCalculation(const std::string& jsonInput, bool& ok) {
-	JsonInput in;
-	std::string err;
-	if (!parseInputJson(jsonInput, in, err)) {
-		ok = false;
-		return std::string("{\"error\": \"") + err + "\"}";
+// Copy of the session scene to calculate on, with its compiled scene and the last run as base
+static JsonInput sessionCalculationInput(Session& session) {
+	std::lock_guard<std::mutex> lock(session.mutex);
+	if (!session.compiled) {
+		session.compiled = std::make_shared<const CompiledScene>(compileScene(session.input.polygons, session.input.inertPolygons));
 	}
+	JsonInput in = session.input;
+	in.compiledScene = session.compiled;
+	in.baseKey = session.lastViewFactorKey;
+	return in;
+}
 
-	std::mt19937_64 rng;
-	if (in.seed.has_value()) {
-		rng.seed(in.seed.value());
-	} else {
-		std::random_device rd;
-		std::seed_seq seedSeq{rd(), rd(), rd(), rd(), rd(), rd()};
-		rng = std::mt19937_64(seedSeq);
+static void recordSessionRun(const std::shared_ptr<Session>& session, const std::string& viewFactorKey) {
+	if (viewFactorKey.empty()) return;
+	std::lock_guard<std::mutex> lock(session->mutex);
+	session->lastViewFactorKey = viewFactorKey;
+}
+
+static std::atomic<bool> g_shutdownRequested {false};
+
+static void onShutdownSignal(int) {
+	g_shutdownRequested.store(true);
+}
+
+// Preview channel: a long-lived SSE stream per session that re-traces a coarse, few-ray version
+// of the scene after every delta. A newer session version cancels the preview in flight.
+struct PreviewOptions {
+	size_t raysPerPoint {128};
+	size_t maxGridSide {16}; // receiver grids are subsampled to at most this many rows and columns
+};
+
+static constexpr size_t kMaxPreviewRays = 100000;
+static constexpr size_t kMaxPreviewGridSide = 256;
+
+// Query parameters "rays" and "grid" override the defaults
+static bool parsePreviewOptions(const httplib::Request& req, PreviewOptions& opts, std::string& error) {
+	auto readParam = [&](const char* name, size_t lo, size_t hi, size_t& out) {
+		if (!req.has_param(name)) return true;
+		const std::string value = req.get_param_value(name);
+		std::uint64_t n = 0;
+		const std::from_chars_result r = std::from_chars(value.data(), value.data() + value.size(), n);
+		if (r.ec != std::errc() || r.ptr != value.data() + value.size() || n < lo || n > hi) {
+			error = std::string(name) + " must be an integer in [" + std::to_string(lo) + ", " + std::to_string(hi) + "]";
+			return false;
+		}
+		out = static_cast<size_t>(n);
+		return true;
+	};
+	return readParam("rays", 1, kMaxPreviewRays, opts.raysPerPoint) &&
+	       readParam("grid", 2, kMaxPreviewGridSide, opts.maxGridSide);
+}
+
+static std::atomic<std::uint64_t> g_previewsRendered {0};
+static std::atomic<std::uint64_t> g_previewsSuperseded {0};
+static std::atomic<std::uint64_t> g_previewSubscribers {0};
+
+// Evenly spaced indices into [0, n) that keep both ends; all of them when n <= limit
+static std::vector<size_t> coarseIndices(size_t n, size_t limit) {
+	std::vector<size_t> idx;
+	if (n <= limit) {
+		for (size_t i = 0; i < n; ++i) idx.push_back(i);
+		return idx;
 	}
+	for (size_t k = 0; k < limit; ++k) idx.push_back((k * (n - 1) + (limit - 1) / 2) / (limit - 1));
+	return idx;
+}
 
-	std::ostringstream out;
-	out << "{";
-	out << "\"success\":true,";
-	out << "\"planes\":[";
-
-	bool firstPlane = true;
-	const bool finished = processReceiverPlanes(in, rng, [&](const std::string& planeName, const PlaneData& planeData,
-	                                                       const std::vector<double>& planeTemperatures, size_t /*idx1*/,
-	                                                       size_t /*totalPlanes*/) {
-		if (!firstPlane) {
-			out << ",";
-		}
-		firstPlane = false;
-		out << "{";
-		out << "\"name\":\"" << planeName << "\",";
-		out << "\"width\":" << planeData.width << ",";
-		out << "\"height\":" << planeData.height << ",";
-		out << "\"values\":[";
-		for (size_t i = 0; i < planeTemperatures.size(); ++i) {
-			if (i > 0) {
-				out << ",";
+struct PreviewPoint {
+	ReceiverPoint point;
+	size_t globalIndex; // index in the full receiver array, which picks the point's seed
+};
+
+// What one preview traces, copied out of the session under its lock
+struct PreviewScene {
+	std::uint64_t version {0};
+	std::shared_ptr<const CompiledScene> compiled;
+	std::uint64_t seed {0};
+	PlaneResults planes;                          // coarse plane shapes; values filled by the trace
+	std::vector<std::vector<PreviewPoint>> points; // per plane
+};
+
+// Caller holds session.mutex
+static PreviewScene snapshotPreviewScene(Session& session, const PreviewOptions& opts) {
+	if (!session.compiled) {
+		session.compiled = std::make_shared<const CompiledScene>(compileScene(session.input.polygons, session.input.inertPolygons));
+	}
+	const JsonInput& in = session.input;
+	PreviewScene scene;
+	scene.version = session.version;
+	scene.compiled = session.compiled;
+	// Unseeded sessions still get a fixed seed so untouched regions don't flicker between previews
+	scene.seed = in.seed.value_or(0);
+	size_t planeOffset = 0;
+	for (const auto& kv : in.planeDataMap) {
+		const PlaneData& full = kv.second;
+		PlaneResult plane {kv.first, full, {}};
+		std::vector<PreviewPoint> points;
+		if (full.width * full.height == full.numPoints) {
+			const std::vector<size_t> rows = coarseIndices(full.height, opts.maxGridSide);
+			const std::vector<size_t> cols = coarseIndices(full.width, opts.maxGridSide);
+			for (size_t r : rows) {
+				for (size_t c : cols) {
+					const size_t idx = planeOffset + r * full.width + c;
+					points.push_back({in.receiverPoints[idx], idx});
+				}
 			}
-			out << planeTemperatures[i];
+			plane.planeData = {cols.size(), rows.size(), points.size()};
+		} else {
+			// Not a grid: nothing to subsample safely, so the preview keeps every point
+			for (size_t i = 0; i < full.numPoints; ++i) points.push_back({in.receiverPoints[planeOffset + i], planeOffset + i});
 		}
-		out << "]";
-		out << "}";
-		return true;
-	});
+		scene.planes.push_back(std::move(plane));
+		scene.points.push_back(std::move(points));
+		planeOffset += full.numPoints;
+	}
+	return scene;
+}
 
-	if (!finished) {
-		ok = false;
-		return std::string("{\"error\": \"calculation interrupted\"}");
+static bool tracePreview(PreviewScene& scene, size_t raysPerPoint, CancelToken& cancel) {
+	const SceneView view = scene.compiled->view();
+	std::vector<std::size_t> hitScratch;
+	std::mt19937_64 pointRng;
+	for (size_t k = 0; k < scene.planes.size(); ++k) {
+		std::vector<double>& values = scene.planes[k].values;
+		values.reserve(scene.points[k].size());
+		for (const PreviewPoint& p : scene.points[k]) {
+			if (cancel.poll()) return false;
+			pointRng.seed(receiverPointSeed(scene.seed, p.globalIndex));
+			double totalTemperature = 0.0;
+			if (!tracePointTemperature(view, p.point, raysPerPoint, pointRng, &cancel, hitScratch, totalTemperature)) return false;
+			values.push_back(totalTemperature);
+		}
 	}
+	return true;
+}
+
+// Streams "started", then one "preview" per session version it finishes (versions superseded
+// mid-trace are skipped), and "closed" if the session goes away.
+static void servePreviewStream(httplib::Response& res, std::shared_ptr<Session> session, PreviewOptions opts) {
+	using httplib::DataSink;
+	auto runOnce = std::make_shared<bool>(false);
+	res.status = 200;
+	res.set_header("Cache-Control", "no-cache");
+	res.set_chunked_content_provider(
+		"text/event-stream",
+		[session, opts, runOnce](size_t /*offset*/, DataSink& sink) -> bool {
+			if (*runOnce) {
+				sink.done();
+				return true;
+			}
+			*runOnce = true;
+			auto sendSse = [&sink](const char* eventName, const std::string& data) -> bool {
+				const std::string msg = std::string("event: ") + eventName + "\ndata: " + data + "\n\n";
+				return sink.write(msg.c_str(), msg.size());
+			};
+			struct SubscriberCount {
+				SubscriberCount() { ++g_previewSubscribers; }
+				~SubscriberCount() { --g_previewSubscribers; }
+			} subscriber;
 
-	out << "]";
-	out << "}";
+			std::ostringstream started;
+			started << "{\"sessionId\":\"" << session->id << "\",\"raysPerPoint\":" << opts.raysPerPoint
+			        << ",\"maxGridSide\":" << opts.maxGridSide << "}";
+			if (!sendSse("started", started.str())) {
+				sink.done();
+				return true;
+			}
 
-	ok = true;
-	return out.str();
+			bool haveRendered = false;
+			std::uint64_t renderedVersion = 0;
+			while (!g_shutdownRequested.load()) {
+				PreviewScene scene;
+				{
+					std::unique_lock<std::mutex> lock(session->mutex);
+					session->changed.wait_for(lock, std::chrono::milliseconds(250), [&]() {
+						return session->closed || !haveRendered || session->version != renderedVersion;
+					});
+					if (session->closed) {
+						lock.unlock();
+						sendSse("closed", "{\"reason\":\"session deleted\"}");
+						break;
+					}
+					if (haveRendered && session->version == renderedVersion) {
+						lock.unlock();
+						if (!sink.is_writable()) break;
+						continue;
+					}
+					scene = snapshotPreviewScene(*session, opts);
+				}
+
+				// Latest wins: the trace stops as soon as the session moves past this version
+				CancelToken cancel;
+				cancel.isConsumerAlive = [&session, &scene]() {
+					if (g_shutdownRequested.load()) return false;
+					std::lock_guard<std::mutex> lock(session->mutex);
+					return !session->closed && session->version == scene.version;
+				};
+				const auto t0 = std::chrono::steady_clock::now();
+				if (!tracePreview(scene, opts.raysPerPoint, cancel)) {
+					++g_previewsSuperseded;
+					continue;
+				}
+				const double elapsedMs =
+					std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+				haveRendered = true;
+				renderedVersion = scene.version;
+				++g_previewsRendered;
+
+				std::string out = "{\"version\":" + std::to_string(scene.version) +
+				                  ",\"raysPerPoint\":" + std::to_string(opts.raysPerPoint) + ",\"elapsedMs\":";
+				appendJsonNumber(out, elapsedMs, ValuePrecision());
+				out += ",\"planes\":[";
+				for (size_t k = 0; k < scene.planes.size(); ++k) {
+					if (k > 0) out += ',';
+					appendPlaneJson(out, scene.planes[k].name, scene.planes[k].planeData, scene.planes[k].values, OutputOptions());
+				}
+				out += "]}";
+				if (!sendSse("preview", out)) break;
+			}
+			sink.done();
+			return true;
+		});
 }
 
-static std::string jsonEscapeStringValue(const std::string& s) {
-	std::string o;
-	o.reserve(s.size() + 8);
-	for (char c : s) {
-		if (c == '\\') {
-			o += "\\\\";
-		} else if (c == '"') {
-			o += "\\\"";
-		} else if (c == '\n') {
-			o += "\\n";
-		} else if (c == '\r') {
-			o += "\\r";
-		} else if (c == '\t') {
-			o += "\\t";
+// --bench-parse [MB]: parse throughput of parseInputJson on a synthetic scene of about MB megabytes,
+// formatted like the frontend's requests (17 significant digits), from one thread up to one per core,
+// then of parseBinaryInput on the same scene
+static int runParseBenchmark(size_t megabytes) {
+	std::mt19937_64 rng(1);
+	std::uniform_real_distribution<double> coord(-50.0, 50.0);
+	std::ostringstream body;
+	body << std::setprecision(17) << "{\"receiver_planes\":{";
+	const size_t targetBytes = megabytes << 20;
+	size_t points = 0;
+	for (size_t plane = 0; static_cast<size_t>(body.tellp()) < targetBytes; ++plane) {
+		body << (plane > 0 ? "," : "") << "\"plane_" << plane << "\":{\"width\":100,\"height\":100,\"points\":[";
+		for (size_t k = 0; k < 10000; ++k, ++points) {
+			body << (k > 0 ? "," : "") << "{\"origin\":[" << coord(rng) << "," << coord(rng) << "," << coord(rng)
+			     << "],\"normal\":[0,0,1]}";
+		}
+		body << "]}";
+	}
+	body << "},\"polygons\":[";
+	for (size_t p = 0; p < 1000; ++p) {
+		body << (p > 0 ? "," : "") << "{\"polygon\":[";
+		for (int v = 0; v < 4; ++v) body << (v > 0 ? "," : "") << "[" << coord(rng) << "," << coord(rng) << "," << coord(rng) << "]";
+		body << "],\"temperature\":" << 300 + p << "}";
+	}
+	body << "],\"num_rays\":1000,\"seed\":42}";
+	const std::string json = body.str();
+
+	const double mb = static_cast<double>(json.size()) / (1 << 20);
+	std::cout << std::fixed << std::setprecision(1) << "payload " << mb << " MB, " << points << " points" << std::endl;
+	std::vector<size_t> threadCounts;
+	for (size_t t = 1; t < parseThreadCount(); t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(parseThreadCount());
+
+	std::vector<ReceiverPoint> reference;
+	for (size_t threads : threadCounts) {
+		double bestSeconds = std::numeric_limits<double>::infinity();
+		const auto start = std::chrono::steady_clock::now();
+		int runs = 0;
+		while (runs < 5 || std::chrono::steady_clock::now() - start < std::chrono::seconds(2)) {
+			JsonInput in;
+			std::string error;
+			const auto t0 = std::chrono::steady_clock::now();
+			const bool ok = parseInputJson(json, in, error, threads);
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+			if (!ok || in.receiverPoints.size() != points) {
+				std::cerr << "parse failed: " << error << std::endl;
+				return 1;
+			}
+			if (reference.empty()) reference = std::move(in.receiverPoints);
+			else if (std::memcmp(reference.data(), in.receiverPoints.data(), points * sizeof(ReceiverPoint)) != 0) {
+				std::cerr << "parse with " << threads << " threads differs from 1 thread" << std::endl;
+				return 1;
+			}
+			bestSeconds = std::min(bestSeconds, seconds);
+			++runs;
+		}
+		std::cout << "  " << threads << " thread(s), best of " << runs << " runs: " << bestSeconds * 1e3 << " ms, "
+		          << mb / bestSeconds << " MB/s, " << static_cast<double>(points) / bestSeconds / 1e6 << " M points/s" << std::endl;
+	}
+
+	// The same scene as an application/vnd.tra.scene body
+	JsonInput parsed;
+	std::string error;
+	parseInputJson(json, parsed, error);
+	const std::string binary = encodeBinaryInput(parsed);
+	const double binaryMb = static_cast<double>(binary.size()) / (1 << 20);
+	double bestSeconds = std::numeric_limits<double>::infinity();
+	const auto start = std::chrono::steady_clock::now();
+	int runs = 0;
+	while (runs < 5 || std::chrono::steady_clock::now() - start < std::chrono::seconds(2)) {
+		JsonInput in;
+		const auto t0 = std::chrono::steady_clock::now();
+		const bool ok = parseBinaryInput(binary, in, error);
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		if (!ok || in.receiverPoints.size() != points || in.polygons.size() != parsed.polygons.size() || !(in.output == parsed.output) ||
+		    std::memcmp(reference.data(), in.receiverPoints.data(), points * sizeof(ReceiverPoint)) != 0) {
+			std::cerr << "binary decode differs from JSON: " << error << std::endl;
+			return 1;
+		}
+		bestSeconds = std::min(bestSeconds, seconds);
+		++runs;
+	}
+	std::cout << "binary " << binaryMb << " MB, best of " << runs << " runs: " << bestSeconds * 1e3 << " ms, "
+	          << binaryMb / bestSeconds << " MB/s, " << static_cast<double>(points) / bestSeconds / 1e6 << " M points/s" << std::endl;
+	return 0;
+}
+
+// q16 self-check: every plane below must decode to within the maxError its frame reports, use all of
+// its coded bytes, and decode finite. Non-finite values cannot be coded; they decode to min.
+static bool checkQuantizedRoundTrip(const std::vector<double>& flux) {
+	const double inf = std::numeric_limits<double>::infinity(), nan = std::numeric_limits<double>::quiet_NaN();
+	std::vector<double> nonFinite = flux, outliers(1000);
+	for (size_t i = 0; i < nonFinite.size(); i += 97) nonFinite[i] = i % 3 == 0 ? nan : i % 3 == 1 ? inf : -inf;
+	for (size_t i = 0; i < outliers.size(); ++i) outliers[i] = i % 2 == 0 ? 0.0 : 1e6 * static_cast<double>(i % 7); // escapes
+	struct Case {
+		const char* label;
+		std::vector<double> values;
+		size_t width;
+		double maxError;
+	};
+	const Case cases[] = {{"100x100", flux, 100, 0.0},
+	                      {"100x100 max_error 0.05", flux, 100, 0.05},
+	                      {"ragged width", flux, 77, 0.0},
+	                      {"constant", std::vector<double>(400, 12.5), 20, 0.0},
+	                      {"constant max_error 1", std::vector<double>(400, -3.0), 20, 1.0},
+	                      {"non-finite values", nonFinite, 100, 0.0},
+	                      {"only non-finite", {nan, inf, -inf, nan}, 2, 0.0},
+	                      {"outliers", outliers, 40, 0.0},
+	                      {"empty", {}, 0, 0.0}};
+	for (const Case& c : cases) {
+		const QuantizedPlane q = quantizePlane(c.values, c.width, c.maxError);
+		size_t bitsRead = 0;
+		const std::vector<double> decoded = decodeQuantizedPlane(q.coded, c.values.size(), c.width, q.min, q.step, bitsRead);
+		bool ok = std::isfinite(q.maxError) && (bitsRead + 7) / 8 == q.coded.size();
+		for (size_t i = 0; i < c.values.size() && ok; ++i) {
+			ok = std::isfinite(decoded[i]) &&
+			     (!std::isfinite(c.values[i]) ? decoded[i] == q.min : std::abs(decoded[i] - c.values[i]) <= q.maxError);
+		}
+		if (c.maxError > 0.0 && q.maxError > c.maxError) ok = false;
+		if (!ok) {
+			std::cerr << "q16 round trip failed: " << c.label << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+// --bench-format: serializing one 100x100 plane's values, the former iostream way against to_chars
+// at each precision, into a buffer reused across runs as the stream writer does, then q16 coding.
+// Both the to_chars output and a q16 round trip are checked first.
+static int runFormatBenchmark() {
+	std::mt19937_64 rng(1);
+	std::uniform_real_distribution<double> flux(0.0, 40.0);
+	std::vector<double> values(100 * 100);
+	for (double& v : values) v = flux(rng);
+
+	auto viaIostream = [&values]() {
+		std::ostringstream out;
+		out << "[";
+		for (size_t i = 0; i < values.size(); ++i) {
+			if (i > 0) out << ",";
+			out << values[i];
+		}
+		out << "]";
+		return out.str();
+	};
+	ValuePrecision shortest, decimals;
+	shortest.mode = ValuePrecision::Mode::Shortest;
+	decimals.mode = ValuePrecision::Mode::Decimals;
+	decimals.digits = 3;
+	std::string buffer;
+	appendJsonNumbers(buffer, values, ValuePrecision());
+	if (buffer != viaIostream()) {
+		std::cerr << "to_chars output differs from iostream output" << std::endl;
+		return 1;
+	}
+	if (!checkQuantizedRoundTrip(values)) return 1;
+
+	auto measure = [](const char* label, const std::function<size_t()>& format) {
+		double bestSeconds = std::numeric_limits<double>::infinity();
+		size_t bytes = 0;
+		const auto start = std::chrono::steady_clock::now();
+		int runs = 0;
+		while (runs < 20 || std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+			const auto t0 = std::chrono::steady_clock::now();
+			bytes = format();
+			bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+			++runs;
+		}
+		std::cout << "  " << std::left << std::setw(22) << label << std::right << std::setw(8) << bestSeconds * 1e6 << " us, "
+		          << std::setw(6) << bytes << " bytes, " << static_cast<double>(bytes) / (1 << 20) / bestSeconds << " MB/s" << std::endl;
+	};
+	std::cout << std::fixed << std::setprecision(1) << "one 100x100 plane (10000 values), best run:" << std::endl;
+	measure("iostream (6 digits)", [&]() { return viaIostream().size(); });
+	const std::pair<const char*, ValuePrecision> precisions[] = {
+		{"to_chars (6 digits)", ValuePrecision()}, {"to_chars shortest", shortest}, {"to_chars 3 decimals", decimals}};
+	for (const auto& p : precisions) {
+		measure(p.first, [&]() {
+			buffer.clear();
+			appendJsonNumbers(buffer, values, p.second);
+			return buffer.size();
+		});
+	}
+	measure("q16", [&]() { return quantizePlane(values, 100, 0.0).coded.size(); });
+	return 0;
+}
+
+static void printUsage(const char* prog) {
+	std::cout << "Usage: " << prog << " [options]" << std::endl;
+	std::cout << "  --port N               Listen port (default 8080)" << std::endl;
+	std::cout << "  --workers H:P,H:P,...  Coordinator mode: shard receiver points across these servers" << std::endl;
+	std::cout << "  --shard-points N       Receiver points per shard in coordinator mode (default 1024)" << std::endl;
+	std::cout << "  --process-workers N    Trace in N isolated worker processes sharing the scene via shared memory" << std::endl;
+	std::cout << "  --cache-mb N           Memory budget of the result cache in MB (default 256, 0 disables)" << std::endl;
+	std::cout << "  --cache-dir DIR        Also keep results on disk in DIR" << std::endl;
+	std::cout << "  --cache-disk-mb N      Disk budget of --cache-dir in MB (default 1024)" << std::endl;
+	std::cout << "  --vf-cache-mb N        Memory for view factors kept for /reweight in MB (default 512)" << std::endl;
+	std::cout << "  --store-dir DIR        Keep traced view factors in DIR so they survive a restart" << std::endl;
+	std::cout << "  --store-disk-mb N      Disk budget of --store-dir in MB (default 4096)" << std::endl;
+	std::cout << "  --resume-window N      Seconds a dropped stream can reconnect with Last-Event-ID (default 60, 0 disables)" << std::endl;
+	std::cout << "  --parse-threads N      Threads parsing the receiver points of one request (default: one per core)" << std::endl;
+	std::cout << "  --bench-parse [MB]     Measure request parsing on a synthetic MB-sized scene (default 32) and exit" << std::endl;
+	std::cout << "  --bench-format         Check and measure result formatting (JSON numbers, q16) on a 100x100 plane and exit" << std::endl;
+}
+
+static bool parseServerOptions(int argc, char** argv, ServerOptions& opts, std::string& error) {
+	for (int a = 1; a < argc; ++a) {
+		const std::string arg = argv[a];
+		auto value = [&](std::string& out) -> bool {
+			if (a + 1 >= argc) { error = "Missing value for " + arg; return false; }
+			out = argv[++a];
+			return true;
+		};
+		std::string v;
+		if (arg == "--port") {
+			if (!value(v)) return false;
+			opts.port = std::atoi(v.c_str());
+			if (opts.port <= 0 || opts.port > 65535) { error = "Invalid port: " + v; return false; }
+		} else if (arg == "--workers") {
+			if (!value(v)) return false;
+			std::stringstream list(v);
+			std::string item;
+			while (std::getline(list, item, ',')) {
+				const size_t colon = item.rfind(':');
+				if (colon == std::string::npos || colon == 0) { error = "Worker must be host:port: " + item; return false; }
+				const int port = std::atoi(item.c_str() + colon + 1);
+				if (port <= 0 || port > 65535) { error = "Invalid worker port: " + item; return false; }
+				opts.workers.push_back({item.substr(0, colon), port});
+			}
+			if (opts.workers.empty()) { error = "--workers needs at least one host:port"; return false; }
+			opts.coordinator = true;
+		} else if (arg == "--shard-points") {
+			if (!value(v)) return false;
+			const long n = std::atol(v.c_str());
+			if (n <= 0) { error = "Invalid shard size: " + v; return false; }
+			opts.shardPoints = static_cast<size_t>(n);
+		} else if (arg == "--process-workers") {
+			if (!value(v)) return false;
+			const long n = std::atol(v.c_str());
+			if (n <= 0 || n > 256) { error = "Invalid process worker count: " + v; return false; }
+#ifdef _WIN32
+			error = "--process-workers is not supported on Windows";
+			return false;
+#else
+			opts.processWorkers = static_cast<size_t>(n);
+#endif
+		} else if (arg == "--cache-mb" || arg == "--cache-disk-mb" || arg == "--vf-cache-mb" || arg == "--store-disk-mb") {
+			if (!value(v)) return false;
+			const long n = std::atol(v.c_str());
+			if (n < 0 || (n == 0 && v != "0")) { error = "Invalid size for " + arg + ": " + v; return false; }
+			(arg == "--cache-mb"        ? opts.cacheMemoryMb
+			 : arg == "--cache-disk-mb" ? opts.cacheDiskMb
+			 : arg == "--vf-cache-mb"   ? opts.viewFactorMb
+			                            : opts.storeDiskMb) = static_cast<size_t>(n);
+		} else if (arg == "--cache-dir") {
+			if (!value(opts.cacheDir)) return false;
+		} else if (arg == "--store-dir") {
+			if (!value(opts.storeDir)) return false;
+		} else if (arg == "--resume-window") {
+			if (!value(v)) return false;
+			const long n = std::atol(v.c_str());
+			if (n < 0 || n > 86400 || (n == 0 && v != "0")) { error = "Invalid resume window: " + v; return false; }
+			opts.resumeWindowSeconds = static_cast<size_t>(n);
+		} else if (arg == "--parse-threads") {
+			if (!value(v)) return false;
+			const long n = std::atol(v.c_str());
+			if (n <= 0 || n > 256) { error = "Invalid parse thread count: " + v; return false; }
+			opts.parseThreads = static_cast<size_t>(n);
+		} else if (arg == "--help" || arg == "-h") {
+			printUsage(argv[0]);
+			std::exit(0);
 		} else {
-			o += c;
+			error = "Unknown option: " + arg;
+			return false;
 		}
 	}
-	return o;
+	if (opts.coordinator && opts.processWorkers > 0) {
+		error = "--workers and --process-workers cannot be combined";
+		return false;
+	}
+	return true;
 }
 
-int main() {
+int main(int argc, char** argv) {
     using namespace httplib;
 
+#ifndef _WIN32
+    // Internal: process-pool worker started by ProcessPool::spawn
+    if (argc == 4 && std::string(argv[1]) == "--shm-worker") {
+        return runShmWorkerProcess(std::atoi(argv[2]), std::atoi(argv[3]));
+    }
+    // A worker dying between our write and its read must not take the server down with SIGPIPE
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench-parse") {
+        const long mb = argc >= 3 ? std::atol(argv[2]) : 32;
+        return runParseBenchmark(static_cast<size_t>(std::max(mb, 1L)));
+    }
+    if (argc >= 2 && std::string(argv[1]) == "--bench-format") {
+        return runFormatBenchmark();
+    }
+
+    std::string optionsError;
+    if (!parseServerOptions(argc, argv, g_options, optionsError)) {
+        std::cerr << optionsError << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+    g_resultCache.configure(g_options.cacheMemoryMb << 20, g_options.cacheDir, g_options.cacheDiskMb << 20);
+    g_tracedRuns.setBudget(g_options.viewFactorMb << 20);
+    g_runStore.configure(g_options.storeDir, g_options.storeDiskMb << 20);
+    g_flights.setResumeWindow(std::chrono::seconds(g_options.resumeWindowSeconds));
+
+#ifndef _WIN32
+    if (g_options.processWorkers > 0) {
+#ifdef __linux__
+        const std::string exePath = "/proc/self/exe";
+#else
+        char resolved[PATH_MAX];
+        const std::string exePath = realpath(argv[0], resolved) ? resolved : argv[0];
+#endif
+        std::string poolError;
+        if (!g_processPool.start(g_options.processWorkers, exePath, poolError)) {
+            std::cerr << "Could not start process pool: " << poolError << std::endl;
+            return 1;
+        }
+    }
+#endif
+
     Server svr;
 
     // Long timeouts for Monte Carlo calculations (can take minutes)
@@ -843,8 +6460,9 @@ int main() {
     // Enable CORS for all routes
     svr.set_default_headers({
         {"Access-Control-Allow-Origin", "*"},
-        {"Access-Control-Allow-Methods", "GET, POST, OPTIONS"},
-        {"Access-Control-Allow-Headers", "Content-Type, Accept"}
+        {"Access-Control-Allow-Methods", "GET, POST, DELETE, OPTIONS"},
+        {"Access-Control-Allow-Headers", "Content-Type, Accept, X-Job-Id, Last-Event-ID"},
+        {"Access-Control-Expose-Headers", "X-Job-Id, X-Cache"}
     });
 
     // Handle OPTIONS requests (CORS preflight)
@@ -860,20 +6478,71 @@ int main() {
 
     // Status endpoint
     svr.Get("/status", [](const Request& req, Response& res) {
-        res.set_content("{\"status\": \"running\", \"version\": \"1.0\"}", "application/json");
+        std::string body = "{\"status\": \"running\", \"version\": \"1.0\"";
+        if (g_options.coordinator) {
+            body += ", \"mode\": \"coordinator\", \"workers\": " + std::to_string(g_options.workers.size());
+        } else if (g_options.processWorkers > 0) {
+            body += ", \"mode\": \"process-pool\", \"processWorkers\": " + std::to_string(g_options.processWorkers);
+        } else {
+            body += ", \"mode\": \"standalone\"";
+        }
+        body += "}";
+        res.set_content(body, "application/json");
+    });
+
+    // Result cache and job counters
+    svr.Get("/metrics", [](const Request& /*req*/, Response& res) {
+        std::ostringstream viewFactors;
+        viewFactors << "{";
+        g_tracedRuns.appendStatsJson(viewFactors);
+        g_runStore.appendStatsJson(viewFactors);
+        viewFactors << "}";
+        std::string body = "{\"runningJobs\": " + std::to_string(g_jobs.size()) +
+                           ", \"sessions\": " + std::to_string(g_sessions.size()) +
+                           ", \"resultCache\": " + g_resultCache.metricsJson() +
+                           ", \"flights\": " + g_flights.metricsJson() +
+                           ", \"viewFactorStore\": " + viewFactors.str() +
+                           ", \"incremental\": {\"runs\": " + std::to_string(g_incrementalRuns.load()) +
+                           ", \"pointsReused\": " + std::to_string(g_incrementalPointsReused.load()) + "}" +
+                           ", \"preview\": {\"subscribers\": " + std::to_string(g_previewSubscribers.load()) +
+                           ", \"rendered\": " + std::to_string(g_previewsRendered.load()) +
+                           ", \"superseded\": " + std::to_string(g_previewsSuperseded.load()) + "}" +
+                           ", \"ingest\": {\"streamed\": " + std::to_string(g_ingestStreamed.load()) +
+                           ", \"tracedEarly\": " + std::to_string(g_ingestTracedEarly.load()) + "}}";
+        res.set_content(body, "application/json");
+    });
+
+    // Cancel a running calculation; the engine stops within a few thousand rays
+    svr.Post(R"(/jobs/([^/]+)/cancel)", [](const Request& req, Response& res) {
+        const std::string id = req.matches[1];
+        if (g_jobs.cancel(id, "cancelled by request")) {
+            std::cout << "Cancel requested for job " << id << std::endl;
+            res.set_content("{\"cancelled\": true}", "application/json");
+        } else {
+            res.status = 404;
+            res.set_content("{\"error\": \"unknown job\"}", "application/json");
+        }
     });
 
     // Main calculation endpoint
     svr.Post("/calculate", [](const Request& req, Response& res) {
         std::cout << "Received calculation request" << std::endl;
         std::cout << "Request body length: " << req.body.length() << " bytes" << std::endl;
-        
+
+        JobScope scope(g_jobs.start(req.get_header_value("X-Job-Id")));
+        Job& job = *scope.job;
+        job.cancel.isConsumerAlive = [&req]() { return !req.is_connection_closed(); };
+        res.set_header("X-Job-Id", job.id);
+
         bool ok = false;
-        std::string result = runCalculation(req.body, ok);
+        std::string cacheStatus;
+        const ResultEncoding encoding = negotiateResultEncoding(req);
+        std::string result = runCalculation(req.body, req.get_header_value("Content-Type"), &job.cancel, ok, cacheStatus, encoding);
+        res.set_header("X-Cache", cacheStatus);
         
         if (ok) {
             std::cout << "Calculation successful" << std::endl;
-            res.set_content(result, "application/json");
+            res.set_content(result, resultContentType(encoding));
         } else {
             std::cout << "Calculation failed: " << result << std::endl;
             res.status = 400;
@@ -881,105 +6550,217 @@ int main() {
         }
     });
 
-    // Same calculation as /calculate, but streams one SSE event per finished receiver plane (then complete).
-    svr.Post("/calculate/stream", [](const Request& req, Response& res) {
+    // New emitter temperatures for a previous trace: every grid is re-weighted, nothing is traced
+    svr.Post("/reweight", [](const Request& req, Response& res) {
+        bool ok = false;
+        const ResultEncoding encoding = negotiateResultEncoding(req);
+        std::string result = runReweight(req.body, ok, encoding);
+        if (!ok) {
+            std::cout << "Reweight failed: " << result << std::endl;
+            res.status = result.find("unknown view_factor_key") != std::string::npos ? 404 : 400;
+        }
+        res.set_content(result, ok ? resultContentType(encoding) : "application/json");
+    });
+
+    // Worker side of coordinator mode: one shard of receiver points, values at full precision
+    svr.Post("/shard", [](const Request& req, Response& res) {
+        JobScope scope(g_jobs.start(req.get_header_value("X-Job-Id")));
+        Job& job = *scope.job;
+        job.cancel.isConsumerAlive = [&req]() { return !req.is_connection_closed(); };
+
+        bool ok = false;
+        std::string result = runShard(req.body, &job.cancel, ok);
+        if (!ok) {
+            std::cout << "Shard " << job.id << " failed: " << result << std::endl;
+            res.status = 400;
+        }
+        res.set_content(result, "application/json");
+    });
+
+    // Same calculation as /calculate, but streams one SSE event per finished receiver plane (then complete),
+    // with throttled "progress" events (points done, rays/s, ETA) in between. The body is read through a
+    // content reader so large uploads are parsed, and their planes traced, while they arrive.
+    svr.Post("/calculate/stream", [](const Request& req, Response& res, const ContentReader& content) {
         std::cout << "Received streaming calculation request" << std::endl;
 
         JsonInput in;
         std::string err;
-        if (!parseInputJson(req.body, in, err)) {
+        std::shared_ptr<IngestTrace> traced;
+        if (!ingestCalculationRequest(req, content, in, traced, err)) {
+            res.status = 400;
+            res.set_content(std::string("{\"error\": \"") + jsonEscapeStringValue(err) + "\"}", "application/json");
+            return;
+        }
+        serveCalculationStream(req, res, std::move(in), nullptr, std::move(traced));
+    });
+
+    // Sessions: the scene is parsed and kept server-side; later calls send only deltas
+    svr.Post("/sessions", [](const Request& req, Response& res) {
+        JsonInput in;
+        std::string err;
+        if (!parseInputJson(req.body, in, err, parseThreadCount())) {
+            res.status = 400;
+            res.set_content(std::string("{\"error\": \"") + jsonEscapeStringValue(err) + "\"}", "application/json");
+            return;
+        }
+        auto session = g_sessions.create(std::move(in));
+        std::lock_guard<std::mutex> lock(session->mutex);
+        std::cout << "Created session " << session->id << " (" << session->input.receiverPoints.size() << " receiver points)" << std::endl;
+        res.status = 201;
+        res.set_content(sessionSummaryJson(*session), "application/json");
+    });
+
+    svr.Get(R"(/sessions/([^/]+))", [](const Request& req, Response& res) {
+        auto session = g_sessions.find(req.matches[1]);
+        if (!session) {
+            res.status = 404;
+            res.set_content("{\"error\": \"unknown session\"}", "application/json");
+            return;
+        }
+        std::lock_guard<std::mutex> lock(session->mutex);
+        res.set_content(sessionSummaryJson(*session), "application/json");
+    });
+
+    svr.Delete(R"(/sessions/([^/]+))", [](const Request& req, Response& res) {
+        if (!g_sessions.erase(req.matches[1])) {
+            res.status = 404;
+            res.set_content("{\"error\": \"unknown session\"}", "application/json");
+            return;
+        }
+        res.set_content("{\"deleted\": true}", "application/json");
+    });
+
+    svr.Post(R"(/sessions/([^/]+)/deltas)", [](const Request& req, Response& res) {
+        auto session = g_sessions.find(req.matches[1]);
+        if (!session) {
+            res.status = 404;
+            res.set_content("{\"error\": \"unknown session\"}", "application/json");
+            return;
+        }
+        std::vector<SessionOp> ops;
+        std::string err;
+        if (!parseSessionOps(req.body, ops, err)) {
+            res.status = 400;
+            res.set_content(std::string("{\"error\": \"") + jsonEscapeStringValue(err) + "\"}", "application/json");
+            return;
+        }
+        std::lock_guard<std::mutex> lock(session->mutex);
+        if (!applySessionOps(*session, ops, err)) {
             res.status = 400;
-            res.set_content(std::string("{\"error\": \"") + err + "\"}", "application/json");
+            res.set_content(std::string("{\"error\": \"") + jsonEscapeStringValue(err) + "\"}", "application/json");
+            return;
+        }
+        res.set_content(sessionSummaryJson(*session), "application/json");
+    });
+
+    svr.Post(R"(/sessions/([^/]+)/calculate)", [](const Request& req, Response& res) {
+        auto session = g_sessions.find(req.matches[1]);
+        if (!session) {
+            res.status = 404;
+            res.set_content("{\"error\": \"unknown session\"}", "application/json");
             return;
         }
+        JobScope scope(g_jobs.start(req.get_header_value("X-Job-Id")));
+        Job& job = *scope.job;
+        job.cancel.isConsumerAlive = [&req]() { return !req.is_connection_closed(); };
+        res.set_header("X-Job-Id", job.id);
 
-        std::mt19937_64 rng;
-        if (in.seed.has_value()) {
-            rng.seed(in.seed.value());
+        bool ok = false;
+        std::string cacheStatus, viewFactorKey;
+        const ResultEncoding encoding = negotiateResultEncoding(req);
+        std::string result =
+            runParsedCalculation(sessionCalculationInput(*session), &job.cancel, ok, cacheStatus, viewFactorKey, encoding);
+        res.set_header("X-Cache", cacheStatus);
+        if (ok) {
+            recordSessionRun(session, viewFactorKey);
         } else {
-            std::random_device rd;
-            std::seed_seq seedSeq{rd(), rd(), rd(), rd(), rd(), rd()};
-            rng = std::mt19937_64(seedSeq);
+            std::cout << "Session calculation failed: " << result << std::endl;
+            res.status = 400;
         }
+        res.set_content(result, ok ? resultContentType(encoding) : "application/json");
+    });
 
-        auto inPtr = std::make_shared<JsonInput>(std::move(in));
-        auto rngPtr = std::make_shared<std::mt19937_64>(std::move(rng));
-        auto runOnce = std::make_shared<bool>(false);
+    svr.Post(R"(/sessions/([^/]+)/calculate/stream)", [](const Request& req, Response& res) {
+        auto session = g_sessions.find(req.matches[1]);
+        if (!session) {
+            res.status = 404;
+            res.set_content("{\"error\": \"unknown session\"}", "application/json");
+            return;
+        }
+        serveCalculationStream(req, res, sessionCalculationInput(*session),
+                               [session](const std::string& viewFactorKey) { recordSessionRun(session, viewFactorKey); });
+    });
 
-        res.status = 200;
-        res.set_header("Cache-Control", "no-cache");
-
-        res.set_chunked_content_provider(
-            "text/event-stream",
-            [inPtr, rngPtr, runOnce](size_t /*offset*/, DataSink& sink) mutable -> bool {
-                if (*runOnce) {
-                    sink.done();
-                    return true;
-                }
-                *runOnce = true;
-
-                auto sendSse = [&sink](const char* eventName, const std::string& data) -> bool {
-                    const std::string msg = std::string("event: ") + eventName + "\ndata: " + data + "\n\n";
-                    return sink.write(msg.c_str(), msg.size());
-                };
-
-                JsonInput& jIn = *inPtr;
-                std::mt19937_64& jRng = *rngPtr;
-                const size_t totalPlanes = jIn.planeDataMap.size();
-
-                if (!sendSse("started", std::string("{\"totalPlanes\":") + std::to_string(totalPlanes) + "}")) {
-                    sink.done();
-                    return true;
-                }
-
-                const bool ok = processReceiverPlanes(jIn, jRng,
-                                                      [&](const std::string& planeName, const PlaneData& planeData,
-                                                          const std::vector<double>& planeTemperatures, size_t planeIndex1Based,
-                                                          size_t nPlanes) {
-                                                          (void)nPlanes;
-                                                          std::ostringstream planeJson;
-                                                          planeJson << "{\"name\":\"" << jsonEscapeStringValue(planeName) << "\"";
-                                                          planeJson << ",\"width\":" << planeData.width;
-                                                          planeJson << ",\"height\":" << planeData.height;
-                                                          planeJson << ",\"planeIndex\":" << planeIndex1Based;
-                                                          planeJson << ",\"totalPlanes\":" << nPlanes;
-                                                          planeJson << ",\"values\":[";
-                                                          for (size_t i = 0; i < planeTemperatures.size(); ++i) {
-                                                              if (i > 0) {
-                                                                  planeJson << ",";
-                                                              }
-                                                              planeJson << planeTemperatures[i];
-                                                          }
-                                                          planeJson << "]}";
-                                                          return sendSse("plane", planeJson.str());
-                                                      });
-
-                if (ok) {
-                    sendSse("complete", "{\"success\":true}");
-                } else {
-                    sendSse("error", "{\"message\":\"calculation interrupted\"}");
-                }
-
-                sink.done();
-                return true;
-            },
-            nullptr);
+    // Preview channel (SSE): a coarse, few-ray trace after every delta posted to /sessions/:id/deltas
+    svr.Get(R"(/sessions/([^/]+)/preview)", [](const Request& req, Response& res) {
+        auto session = g_sessions.find(req.matches[1]);
+        if (!session) {
+            res.status = 404;
+            res.set_content("{\"error\": \"unknown session\"}", "application/json");
+            return;
+        }
+        PreviewOptions opts;
+        std::string err;
+        if (!parsePreviewOptions(req, opts, err)) {
+            res.status = 400;
+            res.set_content(std::string("{\"error\": \"") + jsonEscapeStringValue(err) + "\"}", "application/json");
+            return;
+        }
+        servePreviewStream(res, std::move(session), opts);
     });
 
     std::cout << "========================================" << std::endl;
     std::cout << "Thermal Radiation Analysis Server" << std::endl;
     std::cout << "========================================" << std::endl;
-    std::cout << "Server starting on 0.0.0.0:8080" << std::endl;
-    std::cout << "  Local:   http://localhost:8080" << std::endl;
-    std::cout << "  Network: http://192.168.0.218:8080" << std::endl;
+    std::cout << "Server starting on 0.0.0.0:" << g_options.port << std::endl;
+    std::cout << "  Local:   http://localhost:" << g_options.port << std::endl;
+    if (g_options.coordinator) {
+        std::cout << "Coordinator mode, " << g_options.shardPoints << " points per shard, workers:" << std::endl;
+        for (const auto& w : g_options.workers) std::cout << "  http://" << w.host << ":" << w.port << std::endl;
+    }
+    if (!g_options.cacheDir.empty()) {
+        std::cout << "Result cache on disk: " << g_options.cacheDir << std::endl;
+    }
+    if (!g_options.storeDir.empty()) {
+        std::cout << "View factor store: " << g_options.storeDir << std::endl;
+    }
+    if (g_options.processWorkers > 0) {
+        std::cout << "Process-pool mode: " << g_options.processWorkers << " worker processes" << std::endl;
+    }
     std::cout << "Endpoints:" << std::endl;
     std::cout << "  GET  /health     - Health check" << std::endl;
     std::cout << "  GET  /status     - Server status" << std::endl;
+    std::cout << "  GET  /metrics    - Result cache hit rates and running jobs" << std::endl;
     std::cout << "  POST /calculate        - Run calculation (JSON response)" << std::endl;
-    std::cout << "  POST /calculate/stream - Run calculation (SSE, one event per plane)" << std::endl;
+    std::cout << "  POST /calculate/stream - Run calculation (SSE, per-plane + progress events)" << std::endl;
+    std::cout << "  POST /reweight         - Recompute grids of a traced run for new temperatures" << std::endl;
+    std::cout << "  POST /sessions         - Keep a scene server-side (then /sessions/:id/deltas, /calculate, /calculate/stream)" << std::endl;
+    std::cout << "  GET  /sessions/:id/preview - Live low-ray preview of a session (SSE, re-run on every delta)" << std::endl;
+    std::cout << "  POST /jobs/:id/cancel  - Cancel a running calculation" << std::endl;
+    std::cout << "  POST /shard            - Trace one shard for a coordinator" << std::endl;
     std::cout << "========================================" << std::endl;
 
-    svr.listen("0.0.0.0", 8080);
+    // Ctrl+C / SIGTERM: cancel running jobs so their worker threads return, then stop listening
+    std::signal(SIGINT, onShutdownSignal);
+    std::signal(SIGTERM, onShutdownSignal);
+    std::thread shutdownWatcher([&svr]() {
+        while (!g_shutdownRequested.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        std::cout << "Shutting down: cancelling " << g_jobs.size() << " running job(s)" << std::endl;
+        g_jobs.cancelAll("server shutting down");
+        svr.stop();
+    });
+
+    if (!svr.listen("0.0.0.0", g_options.port)) {
+        std::cerr << "Failed to listen on port " << g_options.port << std::endl;
+    }
+
+    g_shutdownRequested.store(true);
+    shutdownWatcher.join();
+#ifndef _WIN32
+    if (g_options.processWorkers > 0) g_processPool.stop();
+#endif
 
     return 0;
 }
@@ -2,7 +2,7 @@
 
 # Thermal Radiation Analysis System - Master Control Script
 # Usage: ./run.sh [command]
-# Commands: setup, start, stop, restart, status, test
+# Commands: setup, start, stop, restart, status, test, cluster, bench
 
 # Change to script directory so paths work regardless of where it's invoked from
 SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
@@ -10,6 +10,8 @@ cd "$SCRIPT_DIR"
 
 BACKEND_PORT=8080
 FRONTEND_PORT=3000
+WORKER_BASE_PORT=8081
+MAX_CLUSTER_WORKERS=16
 
 # Detect Python (python3 or python)
 PYTHON_CMD=""
@@ -112,6 +114,43 @@ start_backend() {
     fi
 }
 
+# Start N local worker servers and a coordinator on the backend port (sharded execution)
+start_cluster() {
+    local count=${1:-3}
+    print_header "Starting Local Cluster ($count workers)"
+
+    if [ ! -f "bin/server" ]; then
+        print_error "Backend not compiled. Run './run.sh setup' first"
+        return 1
+    fi
+    if [ "$count" -lt 1 ] || [ "$count" -gt $MAX_CLUSTER_WORKERS ]; then
+        print_error "Worker count must be between 1 and $MAX_CLUSTER_WORKERS"
+        return 1
+    fi
+    if is_running $BACKEND_PORT; then
+        print_error "Port $BACKEND_PORT is in use. Run './run.sh stop' first"
+        return 1
+    fi
+
+    local workers=""
+    for ((k = 0; k < count; k++)); do
+        local port=$((WORKER_BASE_PORT + k))
+        if ! is_running $port; then
+            ./bin/server --port $port >/dev/null 2>&1 &
+        fi
+        workers="${workers}localhost:${port},"
+    done
+    sleep 1
+    ./bin/server --workers "${workers%,}" &
+    sleep 2
+    if is_running $BACKEND_PORT; then
+        print_success "Coordinator on http://localhost:$BACKEND_PORT, workers on ports $WORKER_BASE_PORT-$((WORKER_BASE_PORT + count - 1))"
+    else
+        print_error "Failed to start coordinator"
+        return 1
+    fi
+}
+
 # Start frontend
 start_frontend() {
     if ! command -v $PYTHON_CMD >/dev/null 2>&1; then
@@ -180,6 +219,15 @@ stop() {
         print_info "Backend not running"
     fi
     
+    # Stop cluster workers, if any
+    for ((k = 0; k < MAX_CLUSTER_WORKERS; k++)); do
+        WORKER_PID=$(get_pid $((WORKER_BASE_PORT + k)))
+        if [ ! -z "$WORKER_PID" ]; then
+            kill $WORKER_PID 2>/dev/null
+            print_success "Worker on port $((WORKER_BASE_PORT + k)) stopped"
+        fi
+    done
+
     # Stop frontend
     FRONTEND_PID=$(get_pid $FRONTEND_PORT)
     if [ ! -z "$FRONTEND_PID" ]; then
@@ -265,6 +313,18 @@ test_system() {
     echo
 }
 
+# Measure request parsing and result formatting throughput
+bench() {
+    if [ ! -f "bin/server" ]; then
+        print_error "Backend not compiled. Run './run.sh setup' first"
+        return 1
+    fi
+    print_header "Parse Benchmark"
+    ./bin/server --bench-parse "${1:-32}" || return 1
+    print_header "Format Benchmark"
+    ./bin/server --bench-format
+}
+
 # Show usage
 usage() {
     echo "Thermal Radiation Analysis System - Control Script"
@@ -278,6 +338,8 @@ usage() {
     echo "  restart    Restart all servers"
     echo "  status     Check if servers are running"
     echo "  test       Test server endpoints"
+    echo "  cluster N  Start N local workers plus a coordinator backend (default 3)"
+    echo "  bench [MB] Measure request parsing (default 32 MB scene) and result formatting"
     echo "  help       Show this help message"
     echo
     echo "Examples:"
@@ -308,6 +370,12 @@ case "${1:-}" in
     test)
         test_system
         ;;
+    cluster)
+        start_cluster "${2:-3}"
+        ;;
+    bench)
+        bench "${2:-32}"
+        ;;
     help|--help|-h)
         usage
         ;;